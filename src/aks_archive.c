@@ -17,11 +17,27 @@
  */
 #include <config.h>
 #include <aks_file_private.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#if HAVE_GIO_UNIX
+# include <gio/gfiledescriptorbased.h>
+#endif // HAVE_GIO_UNIX
 
 typedef struct _ArchiveData ArchiveData;
 
+/*
+ * Block sizes for libarchive read
+ * callback: a fixed block size is used
+ * when requested, otherwise blocks start
+ * at LA_BLOCK_SIZE and double on every
+ * filled read up to LA_BLOCK_SIZE_MAX
+ *
+ */
+static
+const gsize LA_BLOCK_SIZE = 16384;
 static
-const gsize LA_BLOCK_SIZE = 1024;
+const gsize LA_BLOCK_SIZE_MAX = 1048576;
 
 struct _ArchiveData
 {
@@ -57,6 +73,35 @@ struct _ArchiveData
    *
    */
   gpointer block;
+  gsize block_size;
+  gboolean adaptive;
+  gboolean filled;
+
+  /*
+   * Mapped input, if any
+   * (libarchive reads straight
+   * out of it, so stream is
+   * never touched), and this
+   * reader's own position (stream
+   * is shared with every other
+   * reader, so its position
+   * means nothing to us); archive
+   * is kept alive by whoever
+   * owns reader
+   *
+   */
+  GBytes* mapped;
+  goffset position;
+  FileArchive* archive;
+
+  /*
+   * Gzip decompressor, if archive
+   * is inflated by us (libarchive
+   * only sees uncompressed data
+   * then)
+   *
+   */
+  GzipReader* gzip;
 
   /*
    * GIO miscellaneous objects
@@ -88,6 +133,8 @@ void archive_data_free(ArchiveData* thi5) {
   g_clear_object(&(thi5->stream));
   g_clear_object(&(thi5->cancellable));
   g_clear_pointer(&(thi5->block), g_free);
+  g_clear_pointer(&(thi5->mapped), g_bytes_unref);
+  g_clear_pointer(&(thi5->gzip), _aks_gzip_reader_free);
 
 /*
  * Structure
@@ -96,58 +143,10 @@ void archive_data_free(ArchiveData* thi5) {
   g_slice_free(ArchiveData, thi5);
 }
 
-static
-G_DEFINE_QUARK(aks-archive-stream-use,
-               stream_use);
 static
 G_DEFINE_QUARK(aks-archive-data,
                archive_data);
 
-static int
-archive_open(struct archive* ar,
-             ArchiveData* data)
-{
-/*
- * Ensure stream is not in use
- *
- */
-  gpointer pused =
-  g_object_get_qdata
-  (G_OBJECT(data->stream),
-   stream_use_quark());
-
-  gboolean used =
-  GPOINTER_TO_INT(pused);
-  if G_UNLIKELY(used == TRUE)
-  {
-    g_critical("attempt to open a stream which is already in use\r\n");
-    g_assert_not_reached();
-  }
-
-/*
- * Tag stream as used
- *
- */
-  g_object_set_qdata
-  (G_OBJECT(data->stream),
-   stream_use_quark(),
-   GINT_TO_POINTER(TRUE));
-}
-
-static int
-archive_close(struct archive* ar,
-              ArchiveData* data)
-{
-/*
- * Untag stream as used
- *
- */
-  g_object_set_qdata
-  (G_OBJECT(data->stream),
-   stream_use_quark(),
-   GINT_TO_POINTER(FALSE));
-}
-
 void
 _aks_archive_set_cancellable(GObject         *source_object,
                              struct archive  *ar,
@@ -238,13 +237,69 @@ archive_read(struct archive  *ar,
              const void     **pblock)
 {
   GError* tmp_err = NULL;
+
+  if(data->gzip != NULL)
+  {
+    gssize read =
+    _aks_gzip_reader_read
+    (data->gzip,
+     pblock,
+     data->cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      data->error = tmp_err;
+      pblock[0] = NULL;
+      return ARCHIVE_FATAL;
+    }
+    return (la_ssize_t) read;
+  }
+
+/*
+ * Hand whole remaining
+ * mapping to libarchive,
+ * no copy involved
+ *
+ */
+  if(data->mapped != NULL)
+  {
+    gsize size = 0;
+    const guint8* base =
+    g_bytes_get_data(data->mapped, &size);
+
+    pblock[0] = base + data->position;
+    size -= (gsize) data->position;
+    data->position += (goffset) size;
+    return (la_ssize_t) size;
+  }
+
+/*
+ * A filled block means
+ * libarchive is scanning
+ * sequentially, so grow
+ * block (libarchive is done
+ * with previous block by
+ * the time it calls us again)
+ *
+ */
+  if(data->adaptive == TRUE
+     && data->filled == TRUE
+     && data->block_size < LA_BLOCK_SIZE_MAX)
+  {
+    data->block_size <<= 1;
+    g_clear_pointer(&(data->block), g_free);
+    data->block = g_malloc(data->block_size);
+  }
+
   pblock[0] = data->block;
 
   gsize read = 0;
-  g_input_stream_read_all
-  (data->istream,
+  _aks_archive_pread
+  (data->archive,
+   data->position,
    data->block,
-   LA_BLOCK_SIZE,
+   data->block_size,
    &read,
    data->cancellable,
    &tmp_err);
@@ -255,6 +310,10 @@ archive_read(struct archive  *ar,
     pblock[0] = NULL;
     return ARCHIVE_FATAL;
   }
+
+  data->position += (goffset) read;
+  data->filled =
+  (read == data->block_size);
 return (la_ssize_t) read;
 }
 
@@ -265,7 +324,36 @@ archive_seek(struct archive  *ar,
              int              whence)
 {
   GError* tmp_err = NULL;
-  gint code = G_SEEK_SET;
+
+  if G_UNLIKELY(data->gzip != NULL)
+  {
+    data->error =
+    g_error_new
+    (AKS_FILE_ERROR,
+     AKS_FILE_ERROR_UNSEEKABLE_INPUT,
+     "Seekable input needed\r\n");
+    return ARCHIVE_FATAL;
+  }
+
+  if(data->mapped != NULL)
+  {
+    goffset size = (goffset)
+    g_bytes_get_size(data->mapped);
+
+    switch(whence)
+    {
+      case SEEK_SET: break;
+      case SEEK_CUR: offset += data->position; break;
+      case SEEK_END: offset += size; break;
+      default:
+        g_critical("No standard seek target\r\n");
+        g_assert_not_reached();
+        break;
+    }
+
+    data->position = CLAMP(offset, 0, size);
+    return (la_int64_t) data->position;
+  }
 
   if G_UNLIKELY
     (G_IS_SEEKABLE(data->seekable) == FALSE
@@ -279,32 +367,42 @@ archive_seek(struct archive  *ar,
     return ARCHIVE_FATAL;
   }
 
+/*
+ * Only end of input needs
+ * asking stream, everything
+ * else is just our position
+ *
+ */
   switch(whence)
   {
-    case SEEK_SET: code = G_SEEK_SET; break;
-    case SEEK_CUR: code = G_SEEK_CUR; break;
-    case SEEK_END: code = G_SEEK_END; break;
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += data->position; break;
+    case SEEK_END:
+      {
+        goffset size =
+        _aks_archive_get_size
+        (data->archive,
+         data->cancellable,
+         &tmp_err);
+
+        if G_UNLIKELY(tmp_err != NULL)
+        {
+          data->error = tmp_err;
+          return ARCHIVE_FATAL;
+        }
+
+        offset += size;
+      }
+      break;
     default:
       g_critical("No standard seek target\r\n");
       g_assert_not_reached();
       break;
   }
 
-  g_seekable_seek
-  (data->seekable,
-   (goffset) offset,
-   code,
-   data->cancellable,
-   &tmp_err);
-
-  if G_UNLIKELY(tmp_err != NULL)
-  {
-    data->error = tmp_err;
-    return ARCHIVE_FATAL;
-  }
-
-  return (la_int64_t)
-  g_seekable_tell(data->seekable);
+  data->filled = FALSE;
+  data->position = MAX(offset, 0);
+return (la_int64_t) data->position;
 }
 
 static la_int64_t
@@ -314,6 +412,40 @@ archive_skip(struct archive  *ar,
 {
   GError* tmp_err = NULL;
 
+/*
+ * Inflated data can't be
+ * skipped, libarchive reads
+ * it through instead
+ *
+ */
+  if(data->gzip != NULL)
+    return 0;
+
+  if(data->mapped != NULL)
+  {
+    goffset size = (goffset)
+    g_bytes_get_size(data->mapped);
+
+    request = MIN(request, size - data->position);
+    data->position += request;
+    return request;
+  }
+
+/*
+ * Skipping on seekable input
+ * is just moving our position,
+ * anything else can only
+ * have one reader at once
+ *
+ */
+  if(G_IS_SEEKABLE(data->seekable) == TRUE
+     && g_seekable_can_seek(data->seekable) == TRUE)
+  {
+    data->filled = FALSE;
+    data->position += request;
+    return request;
+  }
+
   gssize skipped =
   g_input_stream_skip
   (data->istream,
@@ -326,6 +458,8 @@ archive_skip(struct archive  *ar,
     data->error = tmp_err;
     return ARCHIVE_FATAL;
   }
+
+  data->position += (goffset) skipped;
 return (la_int64_t) skipped;
 }
 
@@ -342,12 +476,494 @@ _aks_archive_read_free(GObject        *source_object,
    NULL);
 }
 
+GBytes*
+_aks_archive_map_stream(GInputStream   *stream,
+                        goffset         offset)
+{
+#if HAVE_GIO_UNIX
+  GMappedFile* mapped = NULL;
+  GBytes* bytes = NULL;
+  gsize size = 0;
+
+/*
+ * Only local, seekable files
+ * can be mapped (errors here
+ * just mean we fall back
+ * to stream reads)
+ *
+ */
+  if(G_IS_FILE_DESCRIPTOR_BASED(stream) == FALSE
+     || G_IS_SEEKABLE(stream) == FALSE
+     || g_seekable_can_seek(G_SEEKABLE(stream)) == FALSE)
+    return NULL;
+
+  int fd =
+  g_file_descriptor_based_get_fd
+  (G_FILE_DESCRIPTOR_BASED(stream));
+
+  mapped =
+  g_mapped_file_new_from_fd(fd, FALSE, NULL);
+  if G_UNLIKELY(mapped == NULL)
+    return NULL;
+
+  bytes =
+  g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+
+  size =
+  g_bytes_get_size(bytes);
+  if G_UNLIKELY
+    (offset < 0
+     || (gsize) offset > size)
+  {
+    g_bytes_unref(bytes);
+    return NULL;
+  }
+
+  if(offset > 0)
+  {
+    GBytes* slice =
+    g_bytes_new_from_bytes
+    (bytes,
+     (gsize) offset,
+     size - (gsize) offset);
+    g_bytes_unref(bytes);
+    bytes = slice;
+  }
+return bytes;
+#else // !HAVE_GIO_UNIX
+return NULL;
+#endif // HAVE_GIO_UNIX
+}
+
+gboolean
+_aks_archive_pread(FileArchive    *archive,
+                   goffset         offset,
+                   gpointer        buffer,
+                   gsize           size,
+                   gsize          *pread_,
+                   GCancellable   *cancellable,
+                   GError        **error)
+{
+  GError* tmp_err = NULL;
+  GInputStream* stream = archive->base_stream;
+  gboolean seekable =
+  (G_IS_SEEKABLE(stream) == TRUE
+   && g_seekable_can_seek(G_SEEKABLE(stream)) == TRUE);
+  gsize read = 0;
+
+#if HAVE_GIO_UNIX
+/*
+ * Local files are read at
+ * given offset straight away,
+ * stream position untouched,
+ * so readers never wait
+ * on each other
+ *
+ */
+  if(seekable == TRUE
+     && G_IS_FILE_DESCRIPTOR_BASED(stream) == TRUE)
+  {
+    int fd =
+    g_file_descriptor_based_get_fd
+    (G_FILE_DESCRIPTOR_BASED(stream));
+    offset += archive->start_position;
+
+    while(read < size)
+    {
+      if G_UNLIKELY
+        (g_cancellable_set_error_if_cancelled
+         (cancellable,
+          error) == TRUE)
+        return FALSE;
+
+      ssize_t done =
+      pread(fd, (guint8*) buffer + read, size - read, (off_t) (offset + read));
+      if G_UNLIKELY(done < 0)
+      {
+        int errno_ = errno;
+        if(errno_ == EINTR)
+          continue;
+
+        g_set_error
+        (error,
+         G_IO_ERROR,
+         g_io_error_from_errno(errno_),
+         "pread(): %s\r\n",
+         g_strerror(errno_));
+        return FALSE;
+      }
+
+      if(done == 0)
+        break;
+      read += (gsize) done;
+    }
+
+    *pread_ = read;
+    return TRUE;
+  }
+#endif // HAVE_GIO_UNIX
+
+/*
+ * Anything else keeps a
+ * single position, so seek
+ * and read are done on a
+ * stream nobody else is
+ * using meanwhile (unseekable
+ * input can only be read
+ * in order)
+ *
+ */
+  stream =
+  _aks_file_archive_acquire_stream
+  (archive,
+   cancellable,
+   &tmp_err);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return FALSE;
+  }
+
+  if(seekable == TRUE)
+  g_seekable_seek
+  (G_SEEKABLE(stream),
+   archive->start_position + offset,
+   G_SEEK_SET,
+   cancellable,
+   &tmp_err);
+
+  if G_LIKELY(tmp_err == NULL)
+  g_input_stream_read_all
+  (stream,
+   buffer,
+   size,
+   &read,
+   cancellable,
+   &tmp_err);
+
+  _aks_file_archive_release_stream(archive, stream);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return FALSE;
+  }
+
+  *pread_ = read;
+return TRUE;
+}
+
+gboolean
+_aks_archive_read_at(FileArchive    *archive,
+                     goffset         offset,
+                     gpointer        buffer,
+                     gsize           size,
+                     GCancellable   *cancellable,
+                     GError        **error)
+{
+  GError* tmp_err = NULL;
+  gsize read = 0;
+
+  if(archive->mapped != NULL)
+  {
+    gsize total = 0;
+    const guint8* base =
+    g_bytes_get_data(archive->mapped, &total);
+
+    if G_LIKELY
+      (offset >= 0
+       && (gsize) offset <= total
+       && size <= total - (gsize) offset)
+    {
+      memcpy(buffer, base + offset, size);
+      return TRUE;
+    }
+  }
+  else
+  {
+    _aks_archive_pread
+    (archive,
+     offset,
+     buffer,
+     size,
+     &read,
+     cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      return FALSE;
+    }
+
+    if G_LIKELY(read == size)
+      return TRUE;
+  }
+
+  g_set_error
+  (error,
+   AKS_FILE_ERROR,
+   AKS_FILE_ERROR_FAILED,
+   "truncated archive\r\n");
+return FALSE;
+}
+
+goffset
+_aks_archive_get_size(FileArchive    *archive,
+                      GCancellable   *cancellable,
+                      GError        **error)
+{
+  GError* tmp_err = NULL;
+  goffset size = -1;
+
+  if(archive->mapped != NULL)
+    return (goffset) g_bytes_get_size(archive->mapped);
+
+  GInputStream* stream =
+  _aks_file_archive_acquire_stream
+  (archive,
+   cancellable,
+   &tmp_err);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return -1;
+  }
+
+  g_seekable_seek
+  (G_SEEKABLE(stream),
+   0,
+   G_SEEK_END,
+   cancellable,
+   &tmp_err);
+
+  if G_LIKELY(tmp_err == NULL)
+    size = g_seekable_tell(G_SEEKABLE(stream)) - archive->start_position;
+
+  _aks_file_archive_release_stream(archive, stream);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return -1;
+  }
+return size;
+}
+
+/*
+ * Format and filter names
+ * accepted on allow-lists
+ *
+ */
+
+typedef struct _ArchiveName ArchiveName;
+
+struct _ArchiveName
+{
+  const gchar* name;
+  int code;
+};
+
+static
+const ArchiveName format_names[] =
+{
+  {"7zip", ARCHIVE_FORMAT_7ZIP},
+  {"ar", ARCHIVE_FORMAT_AR},
+  {"cab", ARCHIVE_FORMAT_CAB},
+  {"cpio", ARCHIVE_FORMAT_CPIO},
+  {"empty", ARCHIVE_FORMAT_EMPTY},
+  {"iso9660", ARCHIVE_FORMAT_ISO9660},
+  {"lha", ARCHIVE_FORMAT_LHA},
+  {"mtree", ARCHIVE_FORMAT_MTREE},
+  {"rar", ARCHIVE_FORMAT_RAR},
+  {"rar5", ARCHIVE_FORMAT_RAR_V5},
+  {"raw", ARCHIVE_FORMAT_RAW},
+  {"tar", ARCHIVE_FORMAT_TAR},
+  {"warc", ARCHIVE_FORMAT_WARC},
+  {"xar", ARCHIVE_FORMAT_XAR},
+  {"zip", ARCHIVE_FORMAT_ZIP},
+  {NULL, 0},
+};
+
+static
+const ArchiveName filter_names[] =
+{
+  {"bzip2", ARCHIVE_FILTER_BZIP2},
+  {"compress", ARCHIVE_FILTER_COMPRESS},
+  {"grzip", ARCHIVE_FILTER_GRZIP},
+  {"gzip", ARCHIVE_FILTER_GZIP},
+  {"lrzip", ARCHIVE_FILTER_LRZIP},
+  {"lz4", ARCHIVE_FILTER_LZ4},
+  {"lzip", ARCHIVE_FILTER_LZIP},
+  {"lzma", ARCHIVE_FILTER_LZMA},
+  {"lzop", ARCHIVE_FILTER_LZOP},
+  {"rpm", ARCHIVE_FILTER_RPM},
+  {"uu", ARCHIVE_FILTER_UU},
+  {"xz", ARCHIVE_FILTER_XZ},
+  {"zstd", ARCHIVE_FILTER_ZSTD},
+  {NULL, 0},
+};
+
+static int
+lookup_name(const ArchiveName  *names,
+            const gchar        *name)
+{
+  for(; names->name != NULL; names++)
+  {
+    if(g_str_equal(names->name, name))
+      return names->code;
+  }
+return -1;
+}
+
+static gboolean
+check_names(const ArchiveName  *names,
+            gchar             **list,
+            const gchar        *what,
+            GError            **error)
+{
+  for(; list != NULL && *list != NULL; list++)
+  {
+    if G_UNLIKELY(lookup_name(names, *list) < 0)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FAILED,
+       "unknown archive %s '%s'\r\n",
+       what,
+       *list);
+      return FALSE;
+    }
+  }
+return TRUE;
+}
+
+gboolean
+_aks_archive_check_names(FileArchive    *archive,
+                         GError        **error)
+{
+  return
+  check_names(format_names, archive->allowed_formats, "format", error)
+  && check_names(filter_names, archive->allowed_filters, "filter", error);
+}
+
+/*
+ * Once archive has been explored
+ * readers only bid for its format
+ * and filter chain, before that for
+ * whatever caller allowed
+ *
+ */
+
+static void
+support_formats(struct archive  *ar,
+                FileArchive     *archive)
+{
+  gchar** name;
+
+/*
+ * A pinned format which fails
+ * to register leaves reader
+ * bidding as if unpinned
+ *
+ */
+  if(archive->format != 0
+     && archive_read_support_format_by_code
+        (ar,
+         archive->format) >= ARCHIVE_WARN)
+    return;
+
+  if(archive->allowed_formats != NULL)
+  {
+    for(name = archive->allowed_formats; *name != NULL; name++)
+      archive_read_support_format_by_code(ar, lookup_name(format_names, *name));
+  }
+  else
+  {
+    archive_read_support_format_all(ar);
+  }
+}
+
+static void
+support_filters(struct archive  *ar,
+                FileArchive     *archive)
+{
+  gboolean pinned = FALSE;
+  gchar** name;
+  guint i;
+
+/*
+ * Same as above (external
+ * programs, for instance, may
+ * be gone by now); warnings
+ * are fine, they just tell
+ * one is used
+ *
+ */
+  if(archive->filters != NULL)
+  {
+    pinned = TRUE;
+    for(i = 0; i < archive->filters->len; i++)
+    if(g_array_index(archive->filters, int, i) != ARCHIVE_FILTER_NONE
+       && archive_read_support_filter_by_code
+          (ar,
+           g_array_index(archive->filters, int, i)) < ARCHIVE_WARN)
+      pinned = FALSE;
+  }
+
+  if(pinned == TRUE)
+    return;
+
+  if(archive->allowed_filters != NULL)
+  {
+    for(name = archive->allowed_filters; *name != NULL; name++)
+      archive_read_support_filter_by_code(ar, lookup_name(filter_names, *name));
+  }
+  else
+  {
+    archive_read_support_filter_all(ar);
+  }
+}
+
 struct archive*
 _aks_archive_read_make(GObject        *source_object,
-                       GInputStream   *stream,
+                       FileArchive    *archive,
+                       goffset         offset,
                        GCancellable   *cancellable,
                        GError        **error)
 {
+  GError* tmp_err = NULL;
+  GInputStream* stream = archive->base_stream;
+  GBytes* mapped = archive->mapped;
+  gsize block_size = archive->block_size;
+  GzipReader* gzip = NULL;
+
+/*
+ * Gzip archives with checkpoints
+ * are inflated here, offset is
+ * then on uncompressed data
+ *
+ */
+  if(archive->gzip != NULL)
+  {
+    gzip =
+    _aks_gzip_reader_new
+    (archive,
+     offset,
+     cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      return NULL;
+    }
+  }
+
 /*
  * Create archive object
  *
@@ -356,17 +972,38 @@ _aks_archive_read_make(GObject        *source_object,
   archive_read_new();
 
 /*
- * Allocate block and
- * take a reference to
- * stream
+ * Allocate block (unless
+ * input is mapped or gets
+ * inflated here) and take
+ * a reference to stream
+ * (zero block size means
+ * adaptive)
  *
  */
   ArchiveData* data =
   g_slice_new0(ArchiveData);
-  data->block =
-  g_malloc(LA_BLOCK_SIZE);
   data->istream =
   g_object_ref(stream);
+  data->archive = archive;
+  data->position = MAX(offset, 0);
+  data->gzip = gzip;
+
+  if(mapped != NULL)
+  {
+    data->mapped =
+    g_bytes_ref(mapped);
+  }
+  else
+  if(gzip == NULL)
+  {
+    data->adaptive = (block_size == 0);
+    data->block_size =
+    (block_size == 0)
+    ? LA_BLOCK_SIZE
+    : block_size;
+    data->block =
+    g_malloc(data->block_size);
+  }
 
   g_object_set_qdata_full
   (G_OBJECT(source_object),
@@ -378,18 +1015,35 @@ _aks_archive_read_make(GObject        *source_object,
 /*
  * Register supported
  * compression algorithms
- * and formats
+ * and formats (reading from
+ * an entry header means we
+ * already know the format,
+ * and that is uncompressed;
+ * zip members are read by
+ * streaming reader, since
+ * seeking one starts from
+ * central directory)
  *
  */
-  archive_read_support_filter_all(ar);
-  archive_read_support_format_all(ar);
+  if(offset < 0)
+  {
+    support_filters(ar, archive);
+    support_formats(ar, archive);
+  }
+  else
+  if((archive->format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_ZIP)
+  {
+    archive_read_support_format_zip_streamable(ar);
+  }
+  else
+  {
+    archive_read_set_format(ar, archive->format);
+  }
 
 /*
  * Register custom callbacks
  *
  */
-  archive_read_set_open_callback (ar, (archive_open_callback*) archive_open);
-  archive_read_set_close_callback(ar, (archive_close_callback*) archive_close);
   archive_read_set_read_callback (ar, (archive_read_callback*) archive_read);
   archive_read_set_seek_callback (ar, (archive_seek_callback*) archive_seek);
   archive_read_set_skip_callback (ar, (archive_skip_callback*) archive_skip);
@@ -427,18 +1081,15 @@ return ar;
 }
 
 gboolean
-_aks_archive_read_skip_til_entry(GObject               *source_object,
-                                 struct archive        *ar,
-                                 struct archive_entry  *til,
-                                 GCancellable          *cancellable,
-                                 GError               **error)
+_aks_archive_read_skip_til_entry(GObject         *source_object,
+                                 struct archive  *ar,
+                                 const gchar     *name,
+                                 GCancellable    *cancellable,
+                                 GError         **error)
 {
   GError* tmp_err = NULL;
   gboolean success = TRUE;
   struct archive_entry* entry;
-
-  const gchar* name =
-  archive_entry_pathname_utf8(til);
   guint hash = g_str_hash(name);
 
   for(;;)
@@ -477,7 +1128,10 @@ _aks_archive_read_skip_til_entry(GObject               *source_object,
     }
 
     const gchar* name_ =
-    archive_entry_pathname_utf8(entry);
+    archive_entry_pathname(entry);
+    if G_UNLIKELY(name_ == NULL)
+      continue;
+
     guint hash_ = g_str_hash(name_);
 
     if G_UNLIKELY(hash_ == hash)
@@ -550,44 +1204,294 @@ _error_:
 return success;
 }
 
+gboolean
+_aks_archive_dump_to_fd(GObject         *source_object,
+                        struct archive  *ar,
+                        int              fd,
+                        goffset          base,
+                        goffset         *psize,
+                        GCancellable    *cancellable,
+                        GError         **error)
+{
+  gboolean success = TRUE;
+  goffset end = 0;
+  const void* block;
+  la_int64_t offset;
+  size_t size;
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(source_object),
+   ar,
+   cancellable);
+
+  for(;;)
+  {
+    int return_ =
+    archive_read_data_block(ar, &block, &size, &offset);
+    if G_UNLIKELY(return_ < 0)
+    {
+      g_propagate_error
+      (error,
+       _aks_archive_get_gerror
+       (G_OBJECT(source_object),
+        ar));
+      goto_error();
+    }
+
+    if(return_ == ARCHIVE_EOF)
+      break;
+
+  /*
+   * Blocks are written at their
+   * own offset, so holes in sparse
+   * entries stay holes on file
+   *
+   */
+    const guint8* data = block;
+    goffset at = base + offset;
+    gsize left = size;
+
+    while(left > 0)
+    {
+      gssize wrote =
+      pwrite(fd, data, left, (off_t) at);
+      if G_UNLIKELY(wrote < 0)
+      {
+        int e = errno;
+        if(e == EINTR)
+          continue;
+
+        g_set_error
+        (error,
+         G_IO_ERROR,
+         g_io_error_from_errno(e),
+         "%s\r\n",
+         g_strerror(e));
+        goto_error();
+      }
+
+      data += wrote;
+      at += wrote;
+      left -= (gsize) wrote;
+    }
+
+    end = MAX(end, (goffset) (offset + size));
+    if G_UNLIKELY(g_cancellable_set_error_if_cancelled(cancellable, error))
+      goto_error();
+  }
+
+  if G_LIKELY(psize != NULL)
+    *psize = end;
+
+_error_:
+return success;
+}
+
+static GBytes*
+mapped_slice(ArchiveData  *data,
+             const void   *block,
+             gsize         size)
+{
+  gsize total = 0;
+  const guint8* base =
+  g_bytes_get_data(data->mapped, &total);
+  const guint8* block_ = block;
+
+  if(block_ < base
+     || block_ + size > base + total)
+    return NULL;
+return g_bytes_new_from_bytes(data->mapped, block_ - base, size);
+}
+
+GBytes*
+_aks_archive_block_bytes(GObject       *source_object,
+                         const void    *block,
+                         gsize          size)
+{
+  GBytes* bytes = NULL;
+
+  ArchiveData* data =
+  g_object_get_qdata
+  (source_object,
+   archive_data_quark());
+
+/*
+ * Blocks pointing into mapped
+ * input outlive libarchive next
+ * call, anything else is on its
+ * own buffers and must be copied
+ *
+ */
+  if(data->mapped != NULL)
+    bytes = mapped_slice(data, block, size);
+  if(bytes == NULL)
+    bytes = g_bytes_new(block, size);
+return bytes;
+}
+
+/*
+ * Entries are dumped straight into
+ * a plain buffer, allocated once when
+ * entry size is known beforehand, and
+ * holes left by sparse entries
+ * are zero-filled
+ *
+ */
+
+typedef struct _DumpBuffer DumpBuffer;
+
+struct _DumpBuffer
+{
+  guint8* data;
+  gsize length;
+  gsize allocated;
+};
+
+static void
+dump_buffer_reserve(DumpBuffer   *buffer,
+                    gint64        size_hint)
+{
+  if(size_hint > 0
+     && (guint64) size_hint <= G_MAXSIZE)
+  {
+    buffer->data = g_malloc((gsize) size_hint);
+    buffer->allocated = (gsize) size_hint;
+  }
+}
+
+static void
+dump_buffer_put(DumpBuffer   *buffer,
+                const void   *block,
+                gsize         size,
+                gsize         offset)
+{
+  gsize end = offset + size;
+  if G_UNLIKELY(end > buffer->allocated)
+  {
+    gsize allocated =
+    MAX(buffer->allocated, LA_BLOCK_SIZE);
+    while(allocated < end)
+      allocated <<= 1;
+
+    buffer->data = g_realloc(buffer->data, allocated);
+    buffer->allocated = allocated;
+  }
+
+  if(offset > buffer->length)
+    memset(buffer->data + buffer->length, 0, offset - buffer->length);
+  if G_LIKELY(size > 0)
+    memcpy(buffer->data + offset, block, size);
+
+  buffer->length = MAX(buffer->length, end);
+}
+
 GBytes*
 _aks_archive_dump_to_bytes(GObject         *source_object,
                            struct archive  *ar,
+                           gint64           size_hint,
                            GCancellable    *cancellable,
                            GError         **error)
 {
-  GError* tmp_err = NULL;
   gboolean success = TRUE;
   GBytes* return_ = NULL;
+  DumpBuffer buffer = {NULL, 0, 0};
+  const void* block;
+  la_int64_t offset;
+  size_t size;
+  int code;
 
-  GOutputStream* stream = (GOutputStream*)
-  g_memory_output_stream_new_resizable();
+  ArchiveData* data =
+  g_object_get_qdata
+  (source_object,
+   archive_data_quark());
 
-  _aks_archive_dump_to_stream
+  _aks_archive_set_cancellable
   (G_OBJECT(source_object),
    ar,
-   stream,
-   cancellable,
-   &tmp_err);
+   cancellable);
 
-  if G_UNLIKELY(tmp_err != NULL)
+  code =
+  archive_read_data_block(ar, &block, &size, &offset);
+
+/*
+ * On mapped input, uncompressed
+ * entries come out of libarchive
+ * as a single block pointing into
+ * mapping, so hand out a slice
+ * of it instead of a copy
+ *
+ */
+  if(data->mapped != NULL
+     && code == ARCHIVE_OK
+     && offset == 0)
   {
-    g_propagate_error(error, tmp_err);
-    goto_error();
+    GBytes* slice =
+    mapped_slice(data, block, size);
+
+    if(slice != NULL)
+    {
+      const void* next;
+      la_int64_t next_offset;
+      size_t next_size;
+
+      code =
+      archive_read_data_block(ar, &next, &next_size, &next_offset);
+      if(code == ARCHIVE_EOF
+         && (size_hint < 0
+          || (gsize) size_hint <= size))
+        return slice;
+
+      g_bytes_unref(slice);
+      dump_buffer_reserve(&buffer, size_hint);
+      dump_buffer_put(&buffer, block, size, 0);
+
+      block = next;
+      size = next_size;
+      offset = next_offset;
+    }
   }
 
-  g_output_stream_close(stream, cancellable, &tmp_err);
-  if G_UNLIKELY(tmp_err != NULL)
+  if(buffer.allocated == 0)
+    dump_buffer_reserve(&buffer, size_hint);
+
+  for(;;)
   {
-    g_propagate_error(error, tmp_err);
-    goto_error();
+    if G_UNLIKELY(code < 0)
+    {
+      g_propagate_error
+      (error,
+       _aks_archive_get_gerror
+       (G_OBJECT(source_object),
+        ar));
+      goto_error();
+    }
+
+    if(code == ARCHIVE_EOF)
+      break;
+
+    dump_buffer_put(&buffer, block, size, (gsize) offset);
+    if G_UNLIKELY(g_cancellable_set_error_if_cancelled(cancellable, error))
+      goto_error();
+
+    code =
+    archive_read_data_block(ar, &block, &size, &offset);
   }
 
+/*
+ * Sparse entries may
+ * end on a hole
+ *
+ */
+  if(size_hint > 0
+     && (guint64) size_hint > buffer.length)
+    dump_buffer_put(&buffer, NULL, 0, (gsize) size_hint);
+
   return_ =
-  g_memory_output_stream_steal_as_bytes
-  (G_MEMORY_OUTPUT_STREAM(stream));
+  g_bytes_new_take
+  (g_steal_pointer(&(buffer.data)),
+   buffer.length);
 
 _error_:
-  g_object_unref(stream);
+  g_free(buffer.data);
 return return_;
 }
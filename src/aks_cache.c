@@ -0,0 +1,648 @@
+/*  Copyright 2021-2022 MarcosHCK
+ *  This file is part of libakashic.
+ *
+ *  libakashic is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libakashic is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libakashic. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <aks_file_private.h>
+
+/*
+ * On-the-fly cache
+ * Entries contents are kept on a
+ * least-recently-used list shared
+ * by an object and its copies (they
+ * share tree nodes too), and least
+ * used ones are dropped whenever
+ * budget is exceeded; pinned entries
+ * are off list, so never dropped
+ *
+ */
+
+struct _FileCache
+{
+  grefcount refs;
+  GMutex lock;
+  GCond filled;
+  guint64 budget;
+  guint64 size;
+  GQueue lru;
+};
+
+FileCache*
+_aks_cache_new(guint64 budget)
+{
+  FileCache* cache =
+  g_slice_new0(FileCache);
+  g_ref_count_init(&(cache->refs));
+  g_mutex_init(&(cache->lock));
+  g_cond_init(&(cache->filled));
+  g_queue_init(&(cache->lru));
+
+  cache->budget = budget;
+return cache;
+}
+
+FileCache*
+_aks_cache_ref(FileCache* cache)
+{
+  g_ref_count_inc(&(cache->refs));
+return cache;
+}
+
+static void
+drop(FileCache      *cache,
+     FileNodeData   *data)
+{
+  g_queue_unlink(&(cache->lru), &(data->lru));
+  cache->size -= g_bytes_get_size(data->cache);
+  g_clear_pointer(&(data->cache), g_bytes_unref);
+  _aks_node_data_unref(data);
+}
+
+void
+_aks_cache_unref(FileCache* cache)
+{
+  if(g_ref_count_dec(&(cache->refs)))
+  {
+    GList* link;
+    while((link = g_queue_peek_head_link(&(cache->lru))) != NULL)
+      drop(cache, link->data);
+
+    g_mutex_clear(&(cache->lock));
+    g_cond_clear(&(cache->filled));
+    g_slice_free(FileCache, cache);
+  }
+}
+
+static void
+evict(FileCache* cache)
+{
+  if(cache->budget == 0)
+    return;
+
+  while(cache->size > cache->budget)
+  {
+    GList* link =
+    g_queue_peek_tail_link(&(cache->lru));
+    if G_UNLIKELY(link == NULL)
+      break;
+
+    drop(cache, link->data);
+  }
+}
+
+/*
+ * Listed entries are those
+ * with contents and no pins,
+ * list holds a reference
+ * on each of them
+ *
+ */
+
+static void
+list(FileCache      *cache,
+     FileNodeData   *data)
+{
+  data->lru.data = data;
+  g_queue_push_head_link(&(cache->lru), &(data->lru));
+  _aks_node_data_ref(data);
+}
+
+GBytes*
+_aks_cache_lookup(FileCache      *cache,
+                  FileNodeData   *data)
+{
+  GBytes* bytes = NULL;
+
+  g_mutex_lock(&(cache->lock));
+  if(data->cache != NULL)
+  {
+    bytes = g_bytes_ref(data->cache);
+    if(data->pins == 0)
+    {
+      g_queue_unlink(&(cache->lru), &(data->lru));
+      g_queue_push_head_link(&(cache->lru), &(data->lru));
+    }
+  }
+
+  g_mutex_unlock(&(cache->lock));
+return bytes;
+}
+
+GBytes*
+_aks_cache_insert(FileCache      *cache,
+                  FileNodeData   *data,
+                  GBytes         *bytes)
+{
+  g_mutex_lock(&(cache->lock));
+
+/*
+ * Someone else may have
+ * filled it meanwhile
+ *
+ */
+  if G_UNLIKELY(data->cache != NULL)
+  {
+    g_bytes_unref(bytes);
+    bytes = data->cache;
+  }
+  else
+  {
+    data->cache = bytes;
+    cache->size += g_bytes_get_size(bytes);
+    if(data->pins == 0)
+      list(cache, data);
+  }
+
+  g_bytes_ref(bytes);
+  evict(cache);
+  g_mutex_unlock(&(cache->lock));
+return bytes;
+}
+
+void
+_aks_cache_pin(FileCache      *cache,
+               FileNodeData   *data)
+{
+  g_mutex_lock(&(cache->lock));
+  if(data->pins++ == 0
+     && data->cache != NULL)
+  {
+    g_queue_unlink(&(cache->lru), &(data->lru));
+    _aks_node_data_unref(data);
+  }
+
+  g_mutex_unlock(&(cache->lock));
+}
+
+void
+_aks_cache_unpin(FileCache      *cache,
+                 FileNodeData   *data)
+{
+  g_mutex_lock(&(cache->lock));
+  if G_UNLIKELY(data->pins == 0)
+  {
+    g_critical("attempt to unpin an entry which is not pinned\r\n");
+  } else
+  if(--data->pins == 0
+     && data->cache != NULL)
+  {
+    list(cache, data);
+    evict(cache);
+  }
+
+  g_mutex_unlock(&(cache->lock));
+}
+
+/*
+ * Fill claims
+ * Whoever claims an entry is
+ * decoding it, so anyone else
+ * after its contents waits for
+ * them instead of decoding
+ * it all over again
+ *
+ */
+
+gboolean
+_aks_cache_claim(FileCache      *cache,
+                 FileNodeData   *data)
+{
+  gboolean claimed = FALSE;
+
+  g_mutex_lock(&(cache->lock));
+  if(data->filling == FALSE)
+  {
+    data->filling = TRUE;
+    claimed = TRUE;
+  }
+
+  g_mutex_unlock(&(cache->lock));
+return claimed;
+}
+
+static void
+wake_fill_waiters(GCancellable   *cancellable,
+                  FileCache      *cache)
+{
+  g_mutex_lock(&(cache->lock));
+  g_cond_broadcast(&(cache->filled));
+  g_mutex_unlock(&(cache->lock));
+}
+
+/*
+ * Contents are handed straight to
+ * waiters, as they may not fit
+ * on cache; NULL means filling
+ * failed and they should try
+ * themselves (or, with error set,
+ * that waiting got cancelled)
+ *
+ */
+GBytes*
+_aks_cache_wait(FileCache      *cache,
+                FileNodeData   *data,
+                GCancellable   *cancellable,
+                GError        **error)
+{
+  GBytes* bytes = NULL;
+  gulong handler = 0;
+
+  if(cancellable != NULL)
+  {
+    handler =
+    g_cancellable_connect
+    (cancellable,
+     G_CALLBACK(wake_fill_waiters),
+     cache,
+     NULL);
+  }
+
+  g_mutex_lock(&(cache->lock));
+  if(data->filling == TRUE)
+  {
+    data->waiters++;
+    while(data->filling == TRUE
+          && g_cancellable_set_error_if_cancelled(cancellable, error) == FALSE)
+      g_cond_wait(&(cache->filled), &(cache->lock));
+
+    if(data->filling == FALSE
+       && data->fill != NULL)
+      bytes = g_bytes_ref(data->fill);
+    if(--data->waiters == 0)
+      g_clear_pointer(&(data->fill), g_bytes_unref);
+  }
+
+  g_mutex_unlock(&(cache->lock));
+  g_cancellable_disconnect(cancellable, handler);
+return bytes;
+}
+
+void
+_aks_cache_release(FileCache      *cache,
+                   FileNodeData   *data,
+                   GBytes         *bytes)
+{
+  g_mutex_lock(&(cache->lock));
+  data->filling = FALSE;
+
+  if(data->waiters > 0)
+  {
+    g_clear_pointer(&(data->fill), g_bytes_unref);
+    if(bytes != NULL)
+      data->fill = g_bytes_ref(bytes);
+    g_cond_broadcast(&(cache->filled));
+  }
+
+  g_mutex_unlock(&(cache->lock));
+}
+
+/*
+ * Shared cache
+ * Same as above, but process-wide
+ * and keyed by archive identity and
+ * entry name, so unrelated objects
+ * opened on same archive share
+ * contents (under a single budget)
+ * and fill claims
+ *
+ */
+
+typedef struct _SharedEntry SharedEntry;
+
+struct _SharedEntry
+{
+  gchar* key;
+  GBytes* bytes;
+  GList lru;
+  guint pins;
+  gboolean filling;
+  guint waiters;
+  GBytes* fill;
+};
+
+static GMutex shared_lock;
+static GCond shared_filled;
+static GHashTable* shared_table = NULL;
+static GQueue shared_lru = G_QUEUE_INIT;
+static guint64 shared_budget = 0;
+static guint64 shared_size = 0;
+
+static void
+shared_entry_free(SharedEntry* entry)
+{
+  g_clear_pointer(&(entry->bytes), g_bytes_unref);
+  g_clear_pointer(&(entry->fill), g_bytes_unref);
+  g_free(entry->key);
+  g_slice_free(SharedEntry, entry);
+}
+
+static SharedEntry*
+shared_entry_get(const gchar   *key,
+                 gboolean       make)
+{
+  SharedEntry* entry = NULL;
+
+  if G_UNLIKELY(shared_table == NULL)
+  {
+    shared_table =
+    g_hash_table_new_full
+    (g_str_hash,
+     g_str_equal,
+     NULL,
+     (GDestroyNotify)
+     shared_entry_free);
+  }
+
+  entry =
+  g_hash_table_lookup(shared_table, key);
+  if(entry == NULL && make == TRUE)
+  {
+    entry = g_slice_new0(SharedEntry);
+    entry->key = g_strdup(key);
+    entry->lru.data = entry;
+    g_hash_table_insert(shared_table, entry->key, entry);
+  }
+return entry;
+}
+
+/*
+ * Entries someone is filling
+ * or waiting on outlive their
+ * contents until they're done
+ *
+ */
+static void
+shared_forget(SharedEntry* entry)
+{
+  if(entry->bytes == NULL
+     && entry->pins == 0
+     && entry->filling == FALSE
+     && entry->waiters == 0)
+    g_hash_table_remove(shared_table, entry->key);
+}
+
+static void
+shared_drop(SharedEntry* entry)
+{
+  if(entry->bytes != NULL)
+  {
+    shared_size -= g_bytes_get_size(entry->bytes);
+    if(entry->pins == 0)
+      g_queue_unlink(&shared_lru, &(entry->lru));
+    g_clear_pointer(&(entry->bytes), g_bytes_unref);
+  }
+
+  shared_forget(entry);
+}
+
+static void
+shared_evict(void)
+{
+  if(shared_budget == 0)
+    return;
+
+  while(shared_size > shared_budget)
+  {
+    GList* link =
+    g_queue_peek_tail_link(&shared_lru);
+    if G_UNLIKELY(link == NULL)
+      break;
+
+    shared_drop(link->data);
+  }
+}
+
+gchar*
+_aks_shared_cache_key(FileArchive    *archive,
+                      FileNodeData   *data)
+{
+  if(archive->shared_cache == FALSE
+     || archive->identity == NULL
+     || data->entry < 0)
+    return NULL;
+
+  FileEntry* entry =
+  _aks_entry_table_get(archive->entries, data->entry);
+  if G_UNLIKELY(entry->pathname == NULL)
+    return NULL;
+return g_strconcat(archive->identity, ":", entry->pathname, NULL);
+}
+
+void
+_aks_shared_cache_set_budget(guint64 budget)
+{
+  g_mutex_lock(&shared_lock);
+  shared_budget = budget;
+  shared_evict();
+  g_mutex_unlock(&shared_lock);
+}
+
+GBytes*
+_aks_shared_cache_lookup(const gchar* key)
+{
+  GBytes* bytes = NULL;
+
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, FALSE);
+
+  if(entry != NULL
+     && entry->bytes != NULL)
+  {
+    bytes = g_bytes_ref(entry->bytes);
+    if(entry->pins == 0)
+    {
+      g_queue_unlink(&shared_lru, &(entry->lru));
+      g_queue_push_head_link(&shared_lru, &(entry->lru));
+    }
+  }
+
+  g_mutex_unlock(&shared_lock);
+return bytes;
+}
+
+GBytes*
+_aks_shared_cache_insert(const gchar   *key,
+                         GBytes        *bytes)
+{
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, TRUE);
+
+  if G_UNLIKELY(entry->bytes != NULL)
+  {
+    g_bytes_unref(bytes);
+    bytes = entry->bytes;
+  }
+  else
+  {
+    entry->bytes = bytes;
+    shared_size += g_bytes_get_size(bytes);
+    if(entry->pins == 0)
+      g_queue_push_head_link(&shared_lru, &(entry->lru));
+  }
+
+  g_bytes_ref(bytes);
+  shared_evict();
+  g_mutex_unlock(&shared_lock);
+return bytes;
+}
+
+void
+_aks_shared_cache_pin(const gchar* key)
+{
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, TRUE);
+
+  if(entry->pins++ == 0
+     && entry->bytes != NULL)
+    g_queue_unlink(&shared_lru, &(entry->lru));
+
+  g_mutex_unlock(&shared_lock);
+}
+
+void
+_aks_shared_cache_unpin(const gchar* key)
+{
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, FALSE);
+
+  if G_UNLIKELY
+    (entry == NULL
+     || entry->pins == 0)
+  {
+    g_critical("attempt to unpin an entry which is not pinned\r\n");
+  } else
+  if(--entry->pins == 0)
+  {
+    if(entry->bytes == NULL)
+      shared_drop(entry);
+    else
+    {
+      g_queue_push_head_link(&shared_lru, &(entry->lru));
+      shared_evict();
+    }
+  }
+
+  g_mutex_unlock(&shared_lock);
+}
+
+gboolean
+_aks_shared_cache_claim(const gchar* key)
+{
+  gboolean claimed = FALSE;
+
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, TRUE);
+
+  if(entry->filling == FALSE)
+  {
+    entry->filling = TRUE;
+    claimed = TRUE;
+  }
+
+  g_mutex_unlock(&shared_lock);
+return claimed;
+}
+
+static void
+wake_shared_waiters(GCancellable   *cancellable,
+                    gpointer        user_data)
+{
+  g_mutex_lock(&shared_lock);
+  g_cond_broadcast(&shared_filled);
+  g_mutex_unlock(&shared_lock);
+}
+
+GBytes*
+_aks_shared_cache_wait(const gchar    *key,
+                       GCancellable   *cancellable,
+                       GError        **error)
+{
+  GBytes* bytes = NULL;
+  gulong handler = 0;
+
+  if(cancellable != NULL)
+  {
+    handler =
+    g_cancellable_connect
+    (cancellable,
+     G_CALLBACK(wake_shared_waiters),
+     NULL,
+     NULL);
+  }
+
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, FALSE);
+
+  if(entry != NULL
+     && entry->filling == TRUE)
+  {
+    entry->waiters++;
+    while(entry->filling == TRUE
+          && g_cancellable_set_error_if_cancelled(cancellable, error) == FALSE)
+      g_cond_wait(&shared_filled, &shared_lock);
+
+    if(entry->filling == FALSE
+       && entry->fill != NULL)
+      bytes = g_bytes_ref(entry->fill);
+    if(--entry->waiters == 0)
+    {
+      g_clear_pointer(&(entry->fill), g_bytes_unref);
+      shared_forget(entry);
+    }
+  }
+
+  g_mutex_unlock(&shared_lock);
+  g_cancellable_disconnect(cancellable, handler);
+return bytes;
+}
+
+void
+_aks_shared_cache_release(const gchar   *key,
+                          GBytes        *bytes)
+{
+  g_mutex_lock(&shared_lock);
+  SharedEntry* entry =
+  shared_entry_get(key, FALSE);
+
+  if G_UNLIKELY
+    (entry == NULL
+     || entry->filling == FALSE)
+  {
+    g_critical("attempt to release an entry which is not claimed\r\n");
+  } else
+  {
+    entry->filling = FALSE;
+
+    if(entry->waiters > 0)
+    {
+      g_clear_pointer(&(entry->fill), g_bytes_unref);
+      if(bytes != NULL)
+        entry->fill = g_bytes_ref(bytes);
+      g_cond_broadcast(&shared_filled);
+    } else
+    {
+      shared_forget(entry);
+    }
+  }
+
+  g_mutex_unlock(&shared_lock);
+}
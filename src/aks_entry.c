@@ -0,0 +1,144 @@
+/*  Copyright 2021-2022 MarcosHCK
+ *  This file is part of libakashic.
+ *
+ *  libakashic is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libakashic is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libakashic. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <aks_file_private.h>
+
+/*
+ * Entries table
+ * Only metadata exposed through file
+ * info (plus header offset) is kept,
+ * on fixed-size rows of a single
+ * array; strings are packed on a
+ * pool, names and link targets
+ * (which repeat a lot) interned
+ *
+ */
+
+struct _EntryTable
+{
+  grefcount refs;
+  GStringChunk* strings;
+  GArray* rows;
+};
+
+EntryTable*
+_aks_entry_table_new()
+{
+  EntryTable* table =
+  g_slice_new(EntryTable);
+  g_ref_count_init(&(table->refs));
+
+  table->strings = g_string_chunk_new(65536);
+  table->rows = g_array_new(FALSE, FALSE, sizeof(FileEntry));
+return table;
+}
+
+EntryTable*
+_aks_entry_table_ref(EntryTable* table)
+{
+  g_ref_count_inc(&(table->refs));
+return table;
+}
+
+void
+_aks_entry_table_unref(EntryTable* table)
+{
+  if(g_ref_count_dec(&(table->refs)))
+  {
+    g_string_chunk_free(table->strings);
+    g_array_unref(table->rows);
+    g_slice_free(EntryTable, table);
+  }
+}
+
+const gchar*
+_aks_entry_table_intern(EntryTable    *table,
+                        const gchar   *string)
+{
+  if G_UNLIKELY(string == NULL)
+    return NULL;
+return g_string_chunk_insert_const(table->strings, string);
+}
+
+gint
+_aks_entry_table_insert(EntryTable        *table,
+                        gint               row,
+                        const FileEntry   *entry)
+{
+  FileEntry copy = *entry;
+
+/*
+ * Pathnames hardly ever
+ * repeat, so they are not
+ * worth a lookup
+ *
+ */
+  if G_LIKELY(entry->pathname != NULL)
+    copy.pathname = g_string_chunk_insert(table->strings, entry->pathname);
+  if(g_strcmp0(entry->pathname_utf8, entry->pathname) == 0)
+    copy.pathname_utf8 = copy.pathname;
+  else if(entry->pathname_utf8 != NULL)
+    copy.pathname_utf8 = g_string_chunk_insert(table->strings, entry->pathname_utf8);
+  copy.symlink = _aks_entry_table_intern(table, entry->symlink);
+
+  if(row < 0)
+  {
+    row = (gint) table->rows->len;
+    g_array_append_val(table->rows, copy);
+  }
+  else
+  {
+    g_array_index(table->rows, FileEntry, row) = copy;
+  }
+return row;
+}
+
+FileEntry*
+_aks_entry_table_get(EntryTable  *table,
+                     gint         row)
+{
+  g_return_val_if_fail(row >= 0 && (guint) row < table->rows->len, NULL);
+return &g_array_index(table->rows, FileEntry, row);
+}
+
+guint
+_aks_entry_table_get_length(EntryTable* table)
+{
+return table->rows->len;
+}
+
+void
+_aks_entry_from_archive(FileEntry              *entry,
+                        struct archive_entry   *archive_entry)
+{
+  entry->pathname = archive_entry_pathname(archive_entry);
+  entry->pathname_utf8 = archive_entry_pathname_utf8(archive_entry);
+  entry->symlink = archive_entry_symlink(archive_entry);
+  entry->size = archive_entry_size(archive_entry);
+  entry->size_set = archive_entry_size_is_set(archive_entry) != 0;
+  entry->atime = archive_entry_atime(archive_entry);
+  entry->atime_nsec = archive_entry_atime_nsec(archive_entry);
+  entry->birthtime = archive_entry_birthtime(archive_entry);
+  entry->birthtime_nsec = archive_entry_birthtime_nsec(archive_entry);
+  entry->ctime = archive_entry_ctime(archive_entry);
+  entry->ctime_nsec = archive_entry_ctime_nsec(archive_entry);
+  entry->mtime = archive_entry_mtime(archive_entry);
+  entry->mtime_nsec = archive_entry_mtime_nsec(archive_entry);
+  entry->mode = (guint32) archive_entry_mode(archive_entry);
+  entry->offset = -1;
+}
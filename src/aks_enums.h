@@ -23,6 +23,7 @@ typedef enum {
   AKS_CACHE_LEVEL_NONE,
   AKS_CACHE_LEVEL_OTF,
   AKS_CACHE_LEVEL_FULL,
+  AKS_CACHE_LEVEL_DISK,
 } AksCacheLevel;
 
 GType
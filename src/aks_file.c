@@ -17,6 +17,13 @@
  */
 #include <config.h>
 #include <aks_file_private.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#if HAVE_MEMFD_CREATE
+# include <sys/mman.h>
+#endif // HAVE_MEMFD_CREATE
 
 G_DEFINE_QUARK(aks-file-error-quark,
                aks_file_error);
@@ -36,7 +43,16 @@ enum {
   prop_0,
   prop_dup,
   prop_base_stream,
+  prop_base_file,
+  prop_max_readers,
+  prop_formats,
+  prop_filters,
   prop_cache_level,
+  prop_block_size,
+  prop_index_directory,
+  prop_checkpoint_interval,
+  prop_cache_budget,
+  prop_shared_cache,
   prop_filename,
   prop_number,
 };
@@ -44,60 +60,51 @@ enum {
 static
 GParamSpec* properties[prop_number] = {0};
 
-static FileNode*
-search_node_for_file(AksFile   *self,
-                     GFile     *full_,
-                     gboolean   make,
-                     FileNode **last_)
-{
-  GFile* parent = g_file_get_parent(full_);
-  if G_LIKELY(parent != NULL)
-  {
 /*
- * Get parent's node
+ * Child lookup
+ * Nodes are hashed by their parent
+ * and name, so looking a child up
+ * does not depend on how crowded
+ * its directory is
  *
  */
-    FileNode *children = NULL, *node = NULL;
 
-    node =
-    search_node_for_file(self, parent, make, last_);
-    if G_UNLIKELY(node == NULL)
-    {
-      g_object_unref(parent);
-      return NULL;
-    }
-    else
-    {
-      if G_UNLIKELY(last_ != NULL)
-        *last_ = node;
-    }
+static guint
+node_hash(FileNode* node) {
+return g_direct_hash(node->parent) * 31 + node->data->hash_;
+}
 
-/*
- * Iterate children to find
- * next node
- *
- */
-    gchar* name = g_file_get_relative_path(parent, full_);
-    g_object_unref(parent);
-    g_assert(name != NULL);
-    guint hash_ = g_str_hash(name);
+static gboolean
+node_equal(FileNode* node1,
+           FileNode* node2)
+{
+  return
+  (node1->parent == node2->parent
+   && node1->data->hash_ == node2->data->hash_
+   && g_str_equal(node1->data->name, node2->data->name));
+}
 
-    for(children = node->children;
-        children != NULL;
-        children = children->next)
-    {
-      FileNodeData* data = children->data;
-      if(data->hash_ == hash_)
-      {
-        gboolean matches =
-        g_str_equal(data->name, name);
-        if(matches == TRUE)
-        {
-          g_free(name);
-          return children;
-        }
-      }
-    }
+static FileNode*
+search_child(AksFile       *self,
+             FileNode      *node,
+             const gchar   *name,
+             gboolean       make)
+{
+  FileNode* children = NULL;
+  guint hash_ = g_str_hash(name);
+
+  FileNodeData key_data;
+  FileNode key;
+
+  key_data.name = name;
+  key_data.hash_ = hash_;
+  key.data = &key_data;
+  key.parent = node;
+
+  children =
+  g_hash_table_lookup
+  (self->archive->nodes,
+   &key);
 
 /*
  * Wanted children doesn't exists
@@ -105,37 +112,91 @@ search_node_for_file(AksFile   *self,
  * it brand-new
  *
  */
-    if G_UNLIKELY(make == TRUE)
-    {
-      FileNodeData* data = _aks_node_data_new();
-      children = (FileNode*) g_node_new(data);
-      children->data = data;
-
-      data->name = g_strdup(name);
-      data->hash_ = g_str_hash(data->name);
-      g_free(name);
+  if G_UNLIKELY
+    (children == NULL
+     && make == TRUE)
+  {
+    FileNodeData* data = _aks_node_data_new();
+    children = (FileNode*) g_node_new(data);
+    children->data = data;
 
-    /*
-     * Append node
-     *
-     */
-      g_node_append
-      (&(node->node_),
-       &(children->node_));
-      return children;
-    }
+    data->name = _aks_entry_table_intern(self->archive->entries, name);
+    data->hash_ = hash_;
 
-    g_free(name);
+  /*
+   * Append node
+   *
+   */
+    g_node_append
+    (&(node->node_),
+     &(children->node_));
+    g_hash_table_add
+    (self->archive->nodes,
+     children);
   }
-  else
-  {
+return children;
+}
+
+static FileNode*
+search_node_for_file(AksFile       *self,
+                     const gchar   *path,
+                     gboolean       make)
+{
+  FileNode* node = self->archive->root;
+  gchar buffer[256];
+  gchar* heap = NULL;
+  gchar* name;
+
+  if G_UNLIKELY(path == NULL)
+    return node;
+
 /*
- * No parents means root
+ * Components are cut in place
+ * over a copy of path (kept on
+ * stack unless it is a long one),
+ * same as a canonicalized path:
+ * empty and '.' components are
+ * skipped and '..' ones go up,
+ * never above root
  *
  */
-    return self->root;
+  gsize length = strlen(path);
+  if G_LIKELY(length < sizeof(buffer))
+    name = buffer;
+  else
+    name = heap = g_malloc(length + 1);
+  memcpy(name, path, length + 1);
+
+  while(node != NULL && *name != '\0')
+  {
+    gchar* next = strchr(name, '/');
+    if(next != NULL)
+      *next++ = '\0';
+    else
+      next = name + strlen(name);
+
+    if(name[0] == '\0'
+       || (name[0] == '.' && name[1] == '\0'))
+      ;
+    else
+    if(name[0] == '.'
+       && name[1] == '.'
+       && name[2] == '\0')
+    {
+      if(node->parent != NULL)
+        node = node->parent;
+    }
+    else
+    {
+      node =
+      search_child(self, node, name, make);
+    }
+
+    name = next;
   }
-return NULL;
+
+  g_free(heap);
+return node;
 }
 
 #if DEBUG
@@ -206,6 +267,61 @@ print_entries(FileNode* node) {
 
 #endif // DEBUG
 
+static void
+on_zip_entry(const gchar  *name,
+             goffset       offset,
+             AksFile      *self)
+{
+  FileNode* node =
+  search_node_for_file
+  (self,
+   name,
+   FALSE);
+
+  if G_LIKELY
+    (node != NULL
+     && node->data->entry >= 0)
+  {
+    _aks_entry_table_get
+    (self->archive->entries,
+     node->data->entry)->offset = offset;
+  }
+}
+
+static gboolean
+index_zip(AksFile        *self,
+          GCancellable   *cancellable)
+{
+  GError* tmp_err = NULL;
+
+/*
+ * Zip offsets come from central
+ * directory; a broken one just
+ * means entries are looked up
+ * by walking the archive
+ *
+ */
+  if(self->archive->mapped == NULL
+     && (G_IS_SEEKABLE(self->archive->base_stream) == FALSE
+         || g_seekable_can_seek(G_SEEKABLE(self->archive->base_stream)) == FALSE))
+    return FALSE;
+
+  _aks_zip_read_directory
+  (self->archive,
+   (ZipEntryFunc)
+   on_zip_entry,
+   self,
+   cancellable,
+   &tmp_err);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_error_free(tmp_err);
+    return FALSE;
+  }
+return TRUE;
+}
+
 G_DEFINE_TYPE_WITH_CODE
 (AksFile,
  aks_file,
@@ -221,96 +337,202 @@ G_DEFINE_TYPE_WITH_CODE
   aks_file_g_async_initable_iface_init)
  );
 
-static void
-init_fn(GTask* task,
-        AksFile* self,
-        gpointer task_data,
-        GCancellable* cancellable)
+static FileNodeData*
+insert_entry(AksFile          *self,
+             const FileEntry  *entry)
 {
-  gboolean success = TRUE;
-  GError* tmp_err = NULL;
+  FileNode* thi5 =
+  search_node_for_file
+  (self,
+   entry->pathname,
+   TRUE);
+
+  FileNodeData* data = thi5->data;
 
 /*
- * Skip initialization if
- * this object is a copy
+ * Later entries with same
+ * name supersede earlier ones
  *
  */
-  if(self->dup == TRUE)
-    goto _error_;
+  data->entry =
+  _aks_entry_table_insert
+  (self->archive->entries,
+   data->entry,
+   entry);
+return data;
+}
+
+static void
+on_index_entry(const FileEntry  *entry,
+               AksFile          *self)
+{
+  insert_entry(self, entry);
+}
 
 /*
- * Prepare root
+ * Disk cache level spills
+ * entries contents into an
+ * anonymous file, which gets
+ * mapped once exploration
+ * is done
  *
  */
-  FileNodeData* data =
-  _aks_node_data_new();
-  FileNode* root = (FileNode*)
-  g_node_new(data);
-  root->data = data;
-  self->root = root;
 
-  data->entry =
-  archive_entry_new2(NULL);
-  data->name = g_strdup("/");
-  data->hash_ = g_str_hash(data->name);
+typedef struct _SpillSlot SpillSlot;
+
+struct _SpillSlot
+{
+  FileNodeData* data;
+  goffset offset;
+  goffset size;
+};
 
-  archive_entry_copy_pathname
-  (data->entry,
-   data->name);
+static int
+spill_open(GError** error)
+{
+  int fd = -1;
+#if HAVE_MEMFD_CREATE
+  fd = memfd_create("libakashic", MFD_CLOEXEC);
+  if G_LIKELY(fd >= 0)
+    return fd;
+#endif // HAVE_MEMFD_CREATE
+
+  gchar* path = NULL;
+  fd =
+  g_file_open_tmp
+  ("libakashic-XXXXXX",
+   &path,
+   error);
 
-  archive_entry_set_filetype
-  (data->entry,
-   AE_IFDIR);
+  if G_LIKELY(fd >= 0)
+  {
+    g_unlink(path);
+    g_free(path);
+  }
+return fd;
+}
 
-/*
- * Prepare object
- *
- */
-  if(self->cache_level == AKS_CACHE_LEVEL_NONE
-     || self->cache_level == AKS_CACHE_LEVEL_OTF)
+static gboolean
+spill_map(int          fd,
+          goffset      size,
+          GArray      *slots,
+          GError     **error)
+{
+  gboolean success = TRUE;
+  GMappedFile* mapped = NULL;
+  GBytes* bytes = NULL;
+  guint i;
+
+  if G_UNLIKELY(size == 0)
+    bytes = g_bytes_new(NULL, 0);
+  else
   {
-    if G_UNLIKELY
-      (G_IS_SEEKABLE(self->base_stream) == FALSE
-       || g_seekable_can_seek(G_SEEKABLE(self->base_stream)) == FALSE)
+    if G_UNLIKELY(ftruncate(fd, (off_t) size) < 0)
     {
-      g_task_return_new_error
-      (task,
-       AKS_FILE_ERROR,
-       AKS_FILE_ERROR_UNSEEKABLE_INPUT,
-       "Seekable input needed\r\n");
+      int e = errno;
+      g_set_error
+      (error,
+       G_IO_ERROR,
+       g_io_error_from_errno(e),
+       "%s\r\n",
+       g_strerror(e));
       goto_error();
     }
 
-    self->start_position =
-    g_seekable_tell(G_SEEKABLE(self->base_stream));
+    mapped =
+    g_mapped_file_new_from_fd(fd, FALSE, error);
+    if G_UNLIKELY(mapped == NULL)
+      goto_error();
+
+    bytes = g_mapped_file_get_bytes(mapped);
+  }
+
+  for(i = 0; i < slots->len; i++)
+  {
+    SpillSlot* slot =
+    &g_array_index(slots, SpillSlot, i);
+
+    g_clear_pointer(&(slot->data->cache), g_bytes_unref);
+    slot->data->cache =
+    g_bytes_new_from_bytes
+    (bytes,
+     (gsize) slot->offset,
+     (gsize) slot->size);
+  }
+
+_error_:
+  g_clear_pointer(&mapped, g_mapped_file_unref);
+  g_clear_pointer(&bytes, g_bytes_unref);
+return success;
+}
+
+static gboolean
+explore(AksFile        *self,
+        GCancellable   *cancellable,
+        GError        **error)
+{
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  FileArchive* archive = self->archive;
+  struct archive* ar = NULL;
+  GArray* slots = NULL;
+  goffset spilled = 0;
+  int spill = -1;
+  int i;
+
+/*
+ * Gzip archives get inflated
+ * by us when checkpoints are
+ * wanted, so entries can be
+ * read without decompressing
+ * everything before them (full
+ * and disk caching do that only
+ * once anyway)
+ *
+ */
+  if(archive->checkpoint_interval > 0
+     && archive->cache_level != AKS_CACHE_LEVEL_FULL
+     && archive->cache_level != AKS_CACHE_LEVEL_DISK
+     && _aks_gzip_probe(archive, cancellable) == TRUE)
+  {
+    archive->gzip =
+    _aks_gzip_index_new
+    (archive->checkpoint_interval);
   }
 
 /*
  * Create exploration archive object
  *
  */
-  struct archive* ar = NULL;
-
   ar =
   _aks_archive_read_make
   (G_OBJECT(self),
-   self->base_stream,
+   archive,
+   -1,
    cancellable,
    &tmp_err);
 
   if G_UNLIKELY(tmp_err != NULL)
   {
-    g_task_return_error(task, tmp_err);
-    if G_UNLIKELY(ar != NULL)
-    _aks_archive_read_free
-    (G_OBJECT(self),
-     ar);
+    g_propagate_error(error, tmp_err);
     goto_error();
   }
 
   g_assert(ar != NULL);
   struct archive_entry* entry;
 
+  if(archive->cache_level == AKS_CACHE_LEVEL_DISK)
+  {
+    spill = spill_open(&tmp_err);
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      goto_error();
+    }
+
+    slots = g_array_new(FALSE, FALSE, sizeof(SpillSlot));
+  }
+
 /*
  * Explore archive
  *
@@ -321,8 +543,8 @@ init_fn(GTask* task,
     archive_read_next_header(ar, &entry);
     if G_UNLIKELY(return_ < 0)
     {
-      g_task_return_error
-      (task,
+      g_propagate_error
+      (error,
        _aks_archive_get_gerror
        (G_OBJECT(self),
         ar));
@@ -334,8 +556,8 @@ init_fn(GTask* task,
     } else
     if G_UNLIKELY(return_ != ARCHIVE_OK)
     {
-      g_task_return_new_error
-      (task,
+      g_set_error
+      (error,
        AKS_FILE_ERROR,
        AKS_FILE_ERROR_FAILED,
        "%s: " G_STRINGIFY(__LINE__) ": "
@@ -346,99 +568,395 @@ init_fn(GTask* task,
 
   /*
    * Get node for this entry
+   * and copy needed data
    *
    */
-    const gchar* name =
-    archive_entry_pathname(entry);
+    FileEntry entry_;
+    _aks_entry_from_archive(&entry_, entry);
 
-    GFile* full_ =
-    g_file_new_build_filename
-    ("/", name, NULL);
+    if((archive_format(ar) & ARCHIVE_FORMAT_BASE_MASK) != ARCHIVE_FORMAT_ZIP)
+      entry_.offset = archive_read_header_position(ar);
 
-    FileNode* thi5 =
-    search_node_for_file
+    FileNodeData* data =
+    insert_entry
     (self,
-     full_,
-     TRUE,
-     NULL);
+     &entry_);
 
-    FileNodeData* data = thi5->data;
-    g_object_unref(full_);
-
-  /*
-   * Copy needed data
-   *
-   */
-    data->entry = archive_entry_clone(entry);
-    if(self->cache_level == AKS_CACHE_LEVEL_FULL)
+    if(archive->cache_level == AKS_CACHE_LEVEL_FULL)
     {
+      g_clear_pointer(&(data->cache), g_bytes_unref);
       data->cache =
       _aks_archive_dump_to_bytes
       (G_OBJECT(self),
        ar,
+       archive_entry_size_is_set(entry)
+       ? archive_entry_size(entry)
+       : -1,
+       cancellable,
+       &tmp_err);
+
+      if G_UNLIKELY(tmp_err != NULL)
+      {
+        g_propagate_error(error, tmp_err);
+        goto_error();
+      }
+    } else
+    if(archive->cache_level == AKS_CACHE_LEVEL_DISK)
+    {
+      SpillSlot slot = {data, spilled, 0};
+
+      _aks_archive_dump_to_fd
+      (G_OBJECT(self),
+       ar,
+       spill,
+       spilled,
+       &(slot.size),
        cancellable,
        &tmp_err);
 
       if G_UNLIKELY(tmp_err != NULL)
       {
-        g_task_return_error(task, tmp_err);
+        g_propagate_error(error, tmp_err);
         goto_error();
       }
+
+    /*
+     * Sparse entries may end
+     * on a hole, which is
+     * still part of them
+     *
+     */
+      slot.size = MAX(slot.size, archive_entry_size(entry));
+      g_array_append_val(slots, slot);
+      spilled += slot.size;
     }
   }
 
-#if DEBUG
-  print_entries(self->root);
-#endif // DEBUG
+  if(archive->gzip != NULL)
+    _aks_gzip_index_seal(archive->gzip);
+
+  if(spill >= 0)
+  {
+    spill_map(spill, spilled, slots, &tmp_err);
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      goto_error();
+    }
+  }
 
 /*
- * Ready to receive
- * filename notify
- * signal
+ * Uncompressed archives (as seen
+ * by libarchive) in formats which
+ * can be read starting from any
+ * entry header can use offsets above
+ * to skip straight to an entry
  *
  */
-  g_object_thaw_notify(G_OBJECT(self));
+  archive->format = archive_format(ar);
+  archive->filters = g_array_new(FALSE, FALSE, sizeof(int));
+
+  for(i = 0; i < archive_filter_count(ar); i++)
+  {
+    int code = archive_filter_code(ar, i);
+    g_array_append_val(archive->filters, code);
+  }
+
+  if(archive_filter_code(ar, 0) == ARCHIVE_FILTER_NONE)
+  switch(archive->format & ARCHIVE_FORMAT_BASE_MASK)
+  {
+  case ARCHIVE_FORMAT_CPIO:
+  case ARCHIVE_FORMAT_TAR:
+    archive->indexed = TRUE;
+    break;
+  case ARCHIVE_FORMAT_ZIP:
+    archive->indexed =
+    index_zip(self, cancellable);
+    break;
+  }
 
 _error_:
-  if G_LIKELY(success == TRUE)
-    g_task_return_boolean(task, TRUE);
   if G_UNLIKELY(ar != NULL)
     _aks_archive_read_free(G_OBJECT(self), ar);
+  if(slots != NULL)
+    g_array_unref(slots);
+  if(spill >= 0)
+    close(spill);
+return success;
 }
 
-static
-gboolean aks_file_g_async_initable_iface_init_sync(GInitable* pself, GCancellable* cancellable, GError** error) {
-  GTask* task =
-  g_task_new
-  (pself,
-   cancellable,
-   NULL, NULL);
+static void
+init_fn(GTask* task,
+        AksFile* self,
+        gpointer task_data,
+        GCancellable* cancellable)
+{
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  FileArchive* archive = self->archive;
+  gboolean loaded = FALSE;
 
-  g_task_set_name(task, "[libakashic] AksFile::init");
-  g_task_set_priority(task, G_PRIORITY_DEFAULT);
-  g_task_run_in_thread_sync(task, (GTaskThreadFunc) init_fn);
-  gboolean return_ = g_task_propagate_boolean(task, error);
-  g_object_unref(task);
-return return_;
-}
+/*
+ * Skip initialization if
+ * this object is a copy
+ *
+ */
+  if(self->dup == TRUE)
+    goto _error_;
 
-static
-void aks_file_g_initiable_iface_init(GInitableIface* iface) {
-  iface->init = aks_file_g_async_initable_iface_init_sync;
-}
+/*
+ * Something has to give
+ * us archive contents
+ *
+ */
+  if G_UNLIKELY
+    (archive->base_stream == NULL
+     && archive->base_file == NULL)
+  {
+    g_task_return_new_error
+    (task,
+     G_IO_ERROR,
+     G_IO_ERROR_INVALID_ARGUMENT,
+     "Either base-stream or base-file must be set\r\n");
+    goto_error();
+  }
 
-static
-void aks_file_g_async_initable_iface_init_async(GAsyncInitable* pself, int io_priority, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data) {
-  GTask* task =
-  g_task_new
-  (pself,
-   cancellable,
-   callback,
-   user_data);
+  archive->cache =
+  _aks_cache_new
+  (archive->cache_budget);
+  archive->entries =
+  _aks_entry_table_new();
 
-  g_task_set_name(task, "[libakashic] AksFile::init_async");
-  g_task_set_priority(task, io_priority);
-  g_task_run_in_thread(task, (GTaskThreadFunc) init_fn);
+/*
+ * Prepare root
+ *
+ */
+  FileNodeData* data =
+  _aks_node_data_new();
+  FileNode* root = (FileNode*)
+  g_node_new(data);
+  root->data = data;
+  archive->root = root;
+
+  archive->nodes =
+  g_hash_table_new
+  ((GHashFunc)
+   node_hash,
+   (GEqualFunc)
+   node_equal);
+
+  FileEntry entry = {0};
+  entry.pathname = "/";
+  entry.mode = AE_IFDIR;
+  entry.offset = -1;
+
+  data->name = _aks_entry_table_intern(archive->entries, "/");
+  data->hash_ = g_str_hash(data->name);
+  data->entry =
+  _aks_entry_table_insert
+  (archive->entries,
+   -1,
+   &entry);
+
+/*
+ * Open base stream ourselves
+ * if we were given a file,
+ * which also lets readers
+ * open more streams later
+ *
+ */
+  if(archive->base_stream == NULL
+     && archive->base_file != NULL)
+  {
+    archive->base_stream = (GInputStream*)
+    g_file_read
+    (archive->base_file,
+     cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_task_return_error(task, tmp_err);
+      goto_error();
+    }
+  }
+
+  if(archive->max_readers == 0)
+    archive->max_readers = g_get_num_processors();
+
+  _aks_archive_check_names(archive, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_task_return_error(task, tmp_err);
+    goto_error();
+  }
+
+  archive->n_streams = 1;
+  g_queue_push_head
+  (&(archive->idle_streams),
+   g_object_ref(archive->base_stream));
+
+/*
+ * Prepare object
+ *
+ */
+  if(archive->cache_level == AKS_CACHE_LEVEL_NONE
+     || archive->cache_level == AKS_CACHE_LEVEL_OTF)
+  {
+    if G_UNLIKELY
+      (G_IS_SEEKABLE(archive->base_stream) == FALSE
+       || g_seekable_can_seek(G_SEEKABLE(archive->base_stream)) == FALSE)
+    {
+      g_task_return_new_error
+      (task,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_UNSEEKABLE_INPUT,
+       "Seekable input needed\r\n");
+      goto_error();
+    }
+
+  }
+
+/*
+ * Map input when possible,
+ * so libarchive can read
+ * straight from it
+ *
+ */
+  if(G_IS_SEEKABLE(archive->base_stream) == TRUE
+     && g_seekable_can_seek(G_SEEKABLE(archive->base_stream)) == TRUE)
+  {
+    archive->start_position =
+    g_seekable_tell(G_SEEKABLE(archive->base_stream));
+    archive->mapped =
+    _aks_archive_map_stream
+    (archive->base_stream,
+     archive->start_position);
+  }
+
+/*
+ * Both on-disk index and shared
+ * cache are keyed by archive
+ * identity (full and disk caching
+ * need to decompress everything
+ * anyway, so they use neither)
+ *
+ */
+  if((archive->index_directory != NULL
+      && archive->cache_level != AKS_CACHE_LEVEL_FULL
+      && archive->cache_level != AKS_CACHE_LEVEL_DISK)
+     || (archive->shared_cache == TRUE
+      && archive->cache_level == AKS_CACHE_LEVEL_OTF))
+  {
+    archive->identity =
+    _aks_index_get_identity
+    (archive,
+     cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_task_return_error(task, tmp_err);
+      goto_error();
+    }
+  }
+
+/*
+ * Look for an index left by
+ * a previous exploration
+ *
+ */
+  if(archive->index_directory != NULL
+     && archive->cache_level != AKS_CACHE_LEVEL_FULL
+     && archive->cache_level != AKS_CACHE_LEVEL_DISK)
+  {
+    loaded =
+    _aks_index_load
+    (archive,
+     (IndexEntryFunc)
+     on_index_entry,
+     self);
+  }
+
+  if(loaded == FALSE)
+  {
+    explore(self, cancellable, &tmp_err);
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_task_return_error(task, tmp_err);
+      goto_error();
+    }
+
+  /*
+   * Failing to write index
+   * only costs another
+   * exploration next time
+   *
+   */
+    if(archive->index_directory != NULL
+       && archive->cache_level != AKS_CACHE_LEVEL_FULL
+       && archive->cache_level != AKS_CACHE_LEVEL_DISK)
+    {
+      _aks_index_save(archive, &tmp_err);
+      if G_UNLIKELY(tmp_err != NULL)
+      {
+        g_warning("Failed to write archive index: %s\r\n",
+                  tmp_err->message);
+        g_clear_error(&tmp_err);
+      }
+    }
+  }
+
+#if DEBUG
+  print_entries(archive->root);
+#endif // DEBUG
+
+/*
+ * Ready to receive
+ * filename notify
+ * signal
+ *
+ */
+  g_object_thaw_notify(G_OBJECT(self));
+
+_error_:
+  if G_LIKELY(success == TRUE)
+    g_task_return_boolean(task, TRUE);
+}
+
+static
+gboolean aks_file_g_async_initable_iface_init_sync(GInitable* pself, GCancellable* cancellable, GError** error) {
+  GTask* task =
+  g_task_new
+  (pself,
+   cancellable,
+   NULL, NULL);
+
+  g_task_set_name(task, "[libakashic] AksFile::init");
+  g_task_set_priority(task, G_PRIORITY_DEFAULT);
+  g_task_run_in_thread_sync(task, (GTaskThreadFunc) init_fn);
+  gboolean return_ = g_task_propagate_boolean(task, error);
+  g_object_unref(task);
+return return_;
+}
+
+static
+void aks_file_g_initiable_iface_init(GInitableIface* iface) {
+  iface->init = aks_file_g_async_initable_iface_init_sync;
+}
+
+static
+void aks_file_g_async_initable_iface_init_async(GAsyncInitable* pself, int io_priority, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data) {
+  GTask* task =
+  g_task_new
+  (pself,
+   cancellable,
+   callback,
+   user_data);
+
+  g_task_set_name(task, "[libakashic] AksFile::init_async");
+  g_task_set_priority(task, io_priority);
+  g_task_run_in_thread(task, (GTaskThreadFunc) init_fn);
   g_object_unref(task);
 }
 
@@ -459,10 +977,37 @@ void aks_file_class_get_property(GObject* pself, guint prop_id, GValue* value, G
   switch(prop_id)
   {
   case prop_base_stream:
-    g_value_set_object(value, self->base_stream);
+    g_value_set_object(value, self->archive->base_stream);
+    break;
+  case prop_base_file:
+    g_value_set_object(value, self->archive->base_file);
+    break;
+  case prop_max_readers:
+    g_value_set_uint(value, self->archive->max_readers);
+    break;
+  case prop_formats:
+    g_value_set_boxed(value, self->archive->allowed_formats);
+    break;
+  case prop_filters:
+    g_value_set_boxed(value, self->archive->allowed_filters);
     break;
   case prop_cache_level:
-    g_value_set_enum(value, self->cache_level);
+    g_value_set_enum(value, self->archive->cache_level);
+    break;
+  case prop_block_size:
+    g_value_set_uint(value, self->archive->block_size);
+    break;
+  case prop_index_directory:
+    g_value_set_string(value, self->archive->index_directory);
+    break;
+  case prop_checkpoint_interval:
+    g_value_set_uint64(value, self->archive->checkpoint_interval);
+    break;
+  case prop_cache_budget:
+    g_value_set_uint64(value, self->archive->cache_budget);
+    break;
+  case prop_shared_cache:
+    g_value_set_boolean(value, self->archive->shared_cache);
     break;
   case prop_filename:
     g_value_set_string(value, g_file_peek_path(G_FILE(self)));
@@ -482,10 +1027,40 @@ void aks_file_class_set_property(GObject* pself, guint prop_id, const GValue* va
     self->dup = g_value_get_boolean(value);
     break;
   case prop_base_stream:
-    g_set_object(&(self->base_stream), g_value_get_object(value));
+    g_set_object(&(self->archive->base_stream), g_value_get_object(value));
+    break;
+  case prop_base_file:
+    g_set_object(&(self->archive->base_file), g_value_get_object(value));
+    break;
+  case prop_max_readers:
+    self->archive->max_readers = g_value_get_uint(value);
+    break;
+  case prop_formats:
+    g_clear_pointer(&(self->archive->allowed_formats), g_strfreev);
+    self->archive->allowed_formats = g_value_dup_boxed(value);
+    break;
+  case prop_filters:
+    g_clear_pointer(&(self->archive->allowed_filters), g_strfreev);
+    self->archive->allowed_filters = g_value_dup_boxed(value);
     break;
   case prop_cache_level:
-    self->cache_level = g_value_get_enum(value);
+    self->archive->cache_level = g_value_get_enum(value);
+    break;
+  case prop_block_size:
+    self->archive->block_size = g_value_get_uint(value);
+    break;
+  case prop_index_directory:
+    g_clear_pointer(&(self->archive->index_directory), g_free);
+    self->archive->index_directory = g_value_dup_string(value);
+    break;
+  case prop_checkpoint_interval:
+    self->archive->checkpoint_interval = g_value_get_uint64(value);
+    break;
+  case prop_cache_budget:
+    self->archive->cache_budget = g_value_get_uint64(value);
+    break;
+  case prop_shared_cache:
+    self->archive->shared_cache = g_value_get_boolean(value);
     break;
   case prop_filename:
     if G_LIKELY
@@ -512,7 +1087,7 @@ void aks_file_class_finalize(GObject* pself) {
  * Finalize
  *
  */
-  g_node_destroy(&(self->root->node_));
+  g_free(self->filename);
 
 /*
  * Chain-up
@@ -521,29 +1096,6 @@ void aks_file_class_finalize(GObject* pself) {
   G_OBJECT_CLASS(aks_file_parent_class)->finalize(pself);
 }
 
-static void
-dispose_node(FileNode* node) {
-
-/*
- * Unref data
- *
- */
-  g_clear_pointer
-  (&(node->data),
-   _aks_node_data_unref);
-
-/*
- * Dispose node children
- *
- */
-  g_node_children_foreach
-  (&(node->node_),
-   G_TRAVERSE_ALL,
-   (GNodeForeachFunc)
-   dispose_node,
-   NULL);
-}
-
 static
 void aks_file_class_dispose(GObject* pself) {
   AksFile* self = AKS_FILE(pself);
@@ -552,8 +1104,8 @@ void aks_file_class_dispose(GObject* pself) {
  * Dispose
  *
  */
-  g_clear_object(&(self->base_stream));
-  dispose_node(self->root);
+  g_clear_pointer(&(self->archive), _aks_file_archive_unref);
+  self->current = NULL;
 
 /*
  * Chain-up
@@ -597,6 +1149,44 @@ void aks_file_class_init(AksFileClass* klass) {
                         | G_PARAM_CONSTRUCT_ONLY
                         | G_PARAM_STATIC_STRINGS);
 
+  properties[prop_base_file] =
+    g_param_spec_object("base-file",
+                        "base-file",
+                        "base-file",
+                        G_TYPE_FILE,
+                        G_PARAM_READWRITE
+                        | G_PARAM_CONSTRUCT_ONLY
+                        | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_max_readers] =
+    g_param_spec_uint("max-readers",
+                      "max-readers",
+                      "max-readers",
+                      0,
+                      G_MAXUINT,
+                      0,
+                      G_PARAM_READWRITE
+                      | G_PARAM_CONSTRUCT_ONLY
+                      | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_formats] =
+    g_param_spec_boxed("formats",
+                       "formats",
+                       "formats",
+                       G_TYPE_STRV,
+                       G_PARAM_READWRITE
+                       | G_PARAM_CONSTRUCT_ONLY
+                       | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_filters] =
+    g_param_spec_boxed("filters",
+                       "filters",
+                       "filters",
+                       G_TYPE_STRV,
+                       G_PARAM_READWRITE
+                       | G_PARAM_CONSTRUCT_ONLY
+                       | G_PARAM_STATIC_STRINGS);
+
   properties[prop_cache_level] =
     g_param_spec_enum("cache-level",
                       "cache-level",
@@ -607,6 +1197,57 @@ void aks_file_class_init(AksFileClass* klass) {
                       | G_PARAM_CONSTRUCT_ONLY
                       | G_PARAM_STATIC_STRINGS);
 
+  properties[prop_block_size] =
+    g_param_spec_uint("block-size",
+                      "block-size",
+                      "block-size",
+                      0,
+                      G_MAXUINT,
+                      0,
+                      G_PARAM_READWRITE
+                      | G_PARAM_CONSTRUCT_ONLY
+                      | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_index_directory] =
+    g_param_spec_string("index-directory",
+                        "index-directory",
+                        "index-directory",
+                        NULL,
+                        G_PARAM_READWRITE
+                        | G_PARAM_CONSTRUCT_ONLY
+                        | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_checkpoint_interval] =
+    g_param_spec_uint64("checkpoint-interval",
+                        "checkpoint-interval",
+                        "checkpoint-interval",
+                        0,
+                        G_MAXUINT64,
+                        0,
+                        G_PARAM_READWRITE
+                        | G_PARAM_CONSTRUCT_ONLY
+                        | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_cache_budget] =
+    g_param_spec_uint64("cache-budget",
+                        "cache-budget",
+                        "cache-budget",
+                        0,
+                        G_MAXUINT64,
+                        0,
+                        G_PARAM_READWRITE
+                        | G_PARAM_CONSTRUCT_ONLY
+                        | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_shared_cache] =
+    g_param_spec_boolean("shared-cache",
+                         "shared-cache",
+                         "shared-cache",
+                         FALSE,
+                         G_PARAM_READWRITE
+                         | G_PARAM_CONSTRUCT_ONLY
+                         | G_PARAM_STATIC_STRINGS);
+
   properties[prop_filename] =
     g_param_spec_string("filename",
                         "filename",
@@ -624,21 +1265,18 @@ void aks_file_class_init(AksFileClass* klass) {
 
 static
 void on_filename_notify(AksFile* self) {
-  GFile* full_ =
-  g_file_new_for_path(self->filename);
-
   FileNode* node =
   search_node_for_file
   (self,
-   full_,
-   FALSE,
-   NULL);
-  g_object_unref(full_);
+   self->filename,
+   FALSE);
   self->current = node;
 }
 
 static
 void aks_file_init(AksFile* self) {
+  self->archive = _aks_file_archive_new();
+
   g_signal_connect
   (G_OBJECT(self),
    "notify::filename",
@@ -692,6 +1330,45 @@ aks_file_new_async(GInputStream        *base_stream,
    NULL);
 }
 
+GFile*
+aks_file_new_for_file(GFile         *base_file,
+                      AksCacheLevel  cache_level,
+                      const gchar   *filename,
+                      GCancellable  *cancellable,
+                      GError       **error)
+{
+  return (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   cancellable,
+   error,
+   "base-file", base_file,
+   "cache-level", cache_level,
+   "filename", filename,
+   NULL);
+}
+
+void
+aks_file_new_for_file_async(GFile               *base_file,
+                            AksCacheLevel        cache_level,
+                            const gchar         *filename,
+                            int                  io_priority,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  g_async_initable_new_async
+  (AKS_TYPE_FILE,
+   io_priority,
+   cancellable,
+   callback,
+   user_data,
+   "base-file", base_file,
+   "cache-level", cache_level,
+   "filename", filename,
+   NULL);
+}
+
 GFile*
 aks_file_new_finish(GAsyncResult   *res,
                     GError        **error)
@@ -703,3 +1380,671 @@ aks_file_new_finish(GAsyncResult   *res,
    res,
    error);
 }
+
+gboolean
+aks_file_pin(GFile         *file,
+             GCancellable  *cancellable,
+             GError       **error)
+{
+  AksFile* self = AKS_FILE(file);
+  GError* tmp_err = NULL;
+
+  FileNode* node = self->current;
+  if G_UNLIKELY
+    (node == NULL
+     || node->data->entry < 0)
+  {
+    g_set_error
+    (error,
+     G_IO_ERROR,
+     G_IO_ERROR_INVAL,
+     "invalid file\r\n");
+    return FALSE;
+  }
+
+/*
+ * Only on-the-fly cache
+ * ever drops contents
+ *
+ */
+  if(self->archive->cache_level != AKS_CACHE_LEVEL_OTF)
+    return TRUE;
+
+  gchar* key =
+  _aks_shared_cache_key(self->archive, node->data);
+
+  if(key != NULL)
+    _aks_shared_cache_pin(key);
+  else
+    _aks_cache_pin(self->archive->cache, node->data);
+
+  GBytes* bytes =
+  _aks_file_get_bytes
+  (self,
+   node->data,
+   cancellable,
+   &tmp_err);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    if(key != NULL)
+      _aks_shared_cache_unpin(key);
+    else
+      _aks_cache_unpin(self->archive->cache, node->data);
+
+    g_propagate_error(error, tmp_err);
+    g_free(key);
+    return FALSE;
+  }
+
+  g_bytes_unref(bytes);
+  g_free(key);
+return TRUE;
+}
+
+/*
+ * Batch reads
+ * Wanted entries are read in archive
+ * order, each one carrying on from
+ * where previous one left reader
+ *
+ */
+
+typedef struct _ReadManyItem ReadManyItem;
+typedef gboolean (*ReadItemFunc) (ReadManyItem *item, GBytes *bytes, gpointer user_data);
+
+struct _ReadManyItem
+{
+  const gchar* path;
+  FileNodeData* data;
+  gboolean claimed;
+};
+
+static gint
+compare_items(const ReadManyItem  *item1,
+              const ReadManyItem  *item2)
+{
+return item1->data->entry - item2->data->entry;
+}
+
+static gboolean
+read_items(AksFile        *self,
+           GArray         *items,
+           ReadItemFunc    callback,
+           gpointer        user_data,
+           GCancellable   *cancellable,
+           GError        **error)
+{
+  FileArchive* archive = self->archive;
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  FileNodeData* at = NULL;
+  GObject* reader = NULL;
+  struct archive* ar = NULL;
+  GBytes* bytes = NULL;
+  guint i;
+
+  g_array_sort
+  (items,
+   (GCompareFunc)
+   compare_items);
+
+  for(i = 0; i < items->len; i++)
+  {
+    ReadManyItem* item =
+    &g_array_index(items, ReadManyItem, i);
+    FileNodeData* data = item->data;
+
+  /*
+   * Same entry asked for
+   * twice, same contents
+   *
+   */
+    if(i > 0
+       && g_array_index(items, ReadManyItem, i - 1).data == data)
+    {
+      if(callback(item, bytes, user_data) == FALSE)
+        break;
+      continue;
+    }
+
+    g_clear_pointer(&bytes, g_bytes_unref);
+    bytes = _aks_file_lookup_bytes(self, data);
+
+    if(bytes == NULL)
+    {
+      FileEntry* entry =
+      _aks_entry_table_get
+      (archive->entries,
+       data->entry);
+
+      if(ar != NULL)
+      {
+        _aks_archive_set_cancellable
+        (reader,
+         ar,
+         cancellable);
+
+        _aks_archive_read_skip_til_entry
+        (reader,
+         ar,
+         entry->pathname,
+         cancellable,
+         &tmp_err);
+
+      /*
+       * Entry wasn't ahead of
+       * reader, open it on
+       * its own
+       *
+       */
+        if G_UNLIKELY(tmp_err != NULL)
+        {
+          if(g_error_matches
+             (tmp_err,
+              G_IO_ERROR,
+              G_IO_ERROR_CANCELLED))
+          {
+            g_propagate_error(error, tmp_err);
+            goto_error();
+          }
+
+          g_clear_error(&tmp_err);
+          _aks_archive_read_free(reader, ar);
+          g_clear_object(&reader);
+          ar = NULL;
+        }
+      }
+
+      if(ar == NULL)
+      {
+        ar =
+        _aks_file_open_entry
+        (archive,
+         data,
+         &reader,
+         cancellable,
+         &tmp_err);
+
+        if G_UNLIKELY(tmp_err != NULL)
+        {
+          g_propagate_error(error, tmp_err);
+          goto_error();
+        }
+      }
+
+      at = data;
+      bytes =
+      _aks_archive_dump_to_bytes
+      (reader,
+       ar,
+       entry->size,
+       cancellable,
+       &tmp_err);
+
+      if G_UNLIKELY(tmp_err != NULL)
+      {
+        g_propagate_error(error, tmp_err);
+        goto_error();
+      }
+
+      bytes =
+      _aks_file_store_bytes
+      (self,
+       data,
+       bytes);
+    }
+
+    if(callback(item, bytes, user_data) == FALSE)
+      break;
+  }
+
+_error_:
+  if G_LIKELY(ar != NULL)
+  {
+    if G_LIKELY(success == TRUE)
+    {
+      _aks_file_close_entry
+      (archive,
+       at,
+       reader,
+       ar);
+    } else
+    {
+      _aks_archive_read_free(reader, ar);
+      g_object_unref(reader);
+    }
+  }
+
+  g_clear_pointer(&bytes, g_bytes_unref);
+return success;
+}
+
+static gboolean
+is_file(AksFile    *self,
+        FileNode   *node)
+{
+  return
+  (node != NULL
+   && node->data->entry >= 0
+   && (_aks_entry_table_get
+       (self->archive->entries,
+        node->data->entry)->mode & AE_IFMT) != AE_IFDIR);
+}
+
+typedef struct _ReadManyData ReadManyData;
+
+struct _ReadManyData
+{
+  AksFileReadFunc callback;
+  gpointer user_data;
+};
+
+static gboolean
+read_many_item(ReadManyItem   *item,
+               GBytes         *bytes,
+               ReadManyData   *data)
+{
+return data->callback(item->path, bytes, data->user_data);
+}
+
+gboolean
+aks_file_read_many(GFile               *file,
+                   const gchar* const  *paths,
+                   AksFileReadFunc      callback,
+                   gpointer             user_data,
+                   GCancellable        *cancellable,
+                   GError             **error)
+{
+  g_return_val_if_fail(AKS_IS_FILE(file), FALSE);
+  g_return_val_if_fail(paths != NULL, FALSE);
+  g_return_val_if_fail(callback != NULL, FALSE);
+  AksFile* self = AKS_FILE(file);
+  ReadManyData data = {callback, user_data};
+  gboolean success = TRUE;
+  guint i;
+
+  GArray* items =
+  g_array_new(FALSE, FALSE, sizeof(ReadManyItem));
+
+  for(i = 0; paths[i] != NULL; i++)
+  {
+    FileNode* node =
+    search_node_for_file
+    (self,
+     paths[i],
+     FALSE);
+
+    if G_UNLIKELY(node == NULL)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FILE_NOT_FOUND,
+       "file '%s' not found in archive\r\n",
+       paths[i]);
+      goto_error();
+    }
+
+    if G_UNLIKELY(is_file(self, node) == FALSE)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_INVALID_FILE,
+       "'%s' is not a file\r\n",
+       paths[i]);
+      goto_error();
+    }
+
+    ReadManyItem item = {paths[i], node->data, FALSE};
+    g_array_append_val(items, item);
+  }
+
+  success =
+  read_items
+  (self,
+   items,
+   (ReadItemFunc)
+   read_many_item,
+   &data,
+   cancellable,
+   error);
+
+_error_:
+  g_array_unref(items);
+return success;
+}
+
+/*
+ * Prefetch
+ * Wanted entries are claimed right
+ * away, so foreground reads wait for
+ * them instead of decoding them too,
+ * then read on a worker thread in a
+ * single pass, releasing each claim
+ * as soon as entry is cached
+ *
+ */
+
+typedef struct _PrefetchData PrefetchData;
+
+struct _PrefetchData
+{
+  GArray* items;
+  goffset current;
+  goffset total;
+  GFileProgressCallback progress_callback;
+  gpointer progress_data;
+  GMainContext* context;
+  int io_priority;
+};
+
+typedef struct _PrefetchProgress PrefetchProgress;
+
+struct _PrefetchProgress
+{
+  goffset current;
+  goffset total;
+  GFileProgressCallback progress_callback;
+  gpointer progress_data;
+};
+
+static void
+prefetch_data_free(PrefetchData* data)
+{
+  g_array_unref(data->items);
+  g_main_context_unref(data->context);
+  g_slice_free(PrefetchData, data);
+}
+
+static void
+prefetch_release(AksFile        *self,
+                 PrefetchData   *data)
+{
+  guint i;
+  for(i = 0; i < data->items->len; i++)
+  {
+    ReadManyItem* item =
+    &g_array_index(data->items, ReadManyItem, i);
+    if(item->claimed == TRUE)
+    {
+      _aks_file_release(self, item->data, NULL);
+      item->claimed = FALSE;
+    }
+  }
+}
+
+static gboolean
+prefetch_report(PrefetchProgress* progress)
+{
+  progress->progress_callback
+  (progress->current,
+   progress->total,
+   progress->progress_data);
+return G_SOURCE_REMOVE;
+}
+
+static gboolean
+prefetch_item(ReadManyItem   *item,
+              GBytes         *bytes,
+              GTask          *task)
+{
+  AksFile* self = g_task_get_source_object(task);
+  PrefetchData* data = g_task_get_task_data(task);
+
+  if(item->claimed == TRUE)
+  {
+    _aks_file_release(self, item->data, bytes);
+    item->claimed = FALSE;
+  }
+
+  data->current += (goffset) g_bytes_get_size(bytes);
+
+/*
+ * Progress is reported on
+ * caller's main context, always
+ * through a source (invoking it
+ * would run callback right here
+ * when that context is global
+ * default one, which is ours
+ * too)
+ *
+ */
+  if(data->progress_callback != NULL)
+  {
+    PrefetchProgress* progress =
+    g_new(PrefetchProgress, 1);
+    progress->current = data->current;
+    progress->total = data->total;
+    progress->progress_callback = data->progress_callback;
+    progress->progress_data = data->progress_data;
+
+    GSource* source =
+    g_idle_source_new();
+
+    g_source_set_priority(source, data->io_priority);
+    g_source_set_callback(source, (GSourceFunc) prefetch_report, progress, g_free);
+    g_source_attach(source, data->context);
+    g_source_unref(source);
+  }
+return TRUE;
+}
+
+static void
+prefetch_fn(GTask          *task,
+            AksFile        *self,
+            PrefetchData   *data,
+            GCancellable   *cancellable)
+{
+  GError* tmp_err = NULL;
+
+  read_items
+  (self,
+   data->items,
+   (ReadItemFunc)
+   prefetch_item,
+   task,
+   cancellable,
+   &tmp_err);
+
+  prefetch_release(self, data);
+
+  if G_UNLIKELY(tmp_err != NULL)
+    g_task_return_error(task, tmp_err);
+  else
+    g_task_return_boolean(task, TRUE);
+}
+
+static void
+prefetch_add(AksFile        *self,
+             PrefetchData   *data,
+             const gchar    *path,
+             FileNode       *node)
+{
+  GBytes* bytes =
+  _aks_file_lookup_bytes(self, node->data);
+
+  if(bytes != NULL)
+  {
+    g_bytes_unref(bytes);
+    return;
+  }
+
+/*
+ * Entries being filled by
+ * someone else (or listed
+ * twice) are left alone
+ *
+ */
+  if(_aks_file_claim(self, node->data) == FALSE)
+    return;
+
+  ReadManyItem item = {path, node->data, TRUE};
+  g_array_append_val(data->items, item);
+
+  data->total +=
+  _aks_entry_table_get
+  (self->archive->entries,
+   node->data->entry)->size;
+}
+
+void
+aks_file_prefetch_async(GFile                  *file,
+                        const gchar* const     *paths,
+                        int                     io_priority,
+                        GCancellable           *cancellable,
+                        GFileProgressCallback   progress_callback,
+                        gpointer                progress_data,
+                        GAsyncReadyCallback     callback,
+                        gpointer                user_data)
+{
+  g_return_if_fail(AKS_IS_FILE(file));
+  g_return_if_fail(paths != NULL);
+  AksFile* self = AKS_FILE(file);
+  EntryTable* entries = self->archive->entries;
+  guint i, row;
+
+  GTask* task =
+  g_task_new
+  (file,
+   cancellable,
+   callback,
+   user_data);
+
+  PrefetchData* data =
+  g_slice_new0(PrefetchData);
+  data->items = g_array_new(FALSE, FALSE, sizeof(ReadManyItem));
+  data->progress_callback = progress_callback;
+  data->progress_data = progress_data;
+  data->context = g_main_context_ref_thread_default();
+  data->io_priority = io_priority;
+
+  g_task_set_name(task, "[libakashic] AksFile::prefetch_async");
+  g_task_set_priority(task, io_priority);
+  g_task_set_task_data(task, data, (GDestroyNotify) prefetch_data_free);
+
+/*
+ * Only on-the-fly cache
+ * has something to fill
+ *
+ */
+  if(self->archive->cache_level != AKS_CACHE_LEVEL_OTF)
+  {
+    g_task_return_boolean(task, TRUE);
+    goto _error_;
+  }
+
+  for(i = 0; paths[i] != NULL; i++)
+  {
+  /*
+   * Patterns are matched against
+   * every entry name, both made
+   * canonical (as lookups do)
+   * so a pattern under "/dir"
+   * matches "dir/a" and "./dir/a"
+   * alike
+   *
+   */
+    if(strpbrk(paths[i], "*?") != NULL)
+    {
+      gchar* canonical =
+      g_canonicalize_filename(paths[i], "/");
+      GPatternSpec* pattern =
+      g_pattern_spec_new(canonical);
+      g_free(canonical);
+
+      for(row = 0; row < _aks_entry_table_get_length(entries); row++)
+      {
+        FileEntry* entry =
+        _aks_entry_table_get(entries, (gint) row);
+
+        if(entry->pathname == NULL
+           || (entry->mode & AE_IFMT) == AE_IFDIR)
+          continue;
+
+        canonical =
+        g_canonicalize_filename(entry->pathname, "/");
+
+        if(g_pattern_match_string(pattern, canonical) == TRUE)
+        {
+          FileNode* node =
+          search_node_for_file
+          (self,
+           canonical,
+           FALSE);
+
+          if(is_file(self, node) == TRUE)
+            prefetch_add(self, data, entry->pathname, node);
+        }
+
+        g_free(canonical);
+      }
+
+      g_pattern_spec_free(pattern);
+      continue;
+    }
+
+    FileNode* node =
+    search_node_for_file
+    (self,
+     paths[i],
+     FALSE);
+
+    if G_UNLIKELY(is_file(self, node) == FALSE)
+    {
+      prefetch_release(self, data);
+      g_task_return_new_error
+      (task,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FILE_NOT_FOUND,
+       "file '%s' not found in archive\r\n",
+       paths[i]);
+      goto _error_;
+    }
+
+    prefetch_add(self, data, paths[i], node);
+  }
+
+  g_task_run_in_thread(task, (GTaskThreadFunc) prefetch_fn);
+
+_error_:
+  g_object_unref(task);
+}
+
+gboolean
+aks_file_prefetch_finish(GFile          *file,
+                         GAsyncResult   *res,
+                         GError        **error)
+{
+  g_return_val_if_fail(g_task_is_valid(res, file), FALSE);
+return g_task_propagate_boolean(G_TASK(res), error);
+}
+
+void
+aks_file_unpin(GFile* file)
+{
+  AksFile* self = AKS_FILE(file);
+  FileNode* node = self->current;
+
+  if G_LIKELY
+    (node != NULL
+     && node->data->entry >= 0
+     && self->archive->cache_level == AKS_CACHE_LEVEL_OTF)
+  {
+    gchar* key =
+    _aks_shared_cache_key(self->archive, node->data);
+
+    if(key != NULL)
+      _aks_shared_cache_unpin(key);
+    else
+      _aks_cache_unpin(self->archive->cache, node->data);
+    g_free(key);
+  }
+}
+
+void
+aks_file_set_shared_cache_budget(guint64 budget)
+{
+  _aks_shared_cache_set_budget(budget);
+}
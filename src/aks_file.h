@@ -64,6 +64,10 @@ typedef enum {
 typedef struct _AksFile       AksFile;
 typedef struct _AksFileClass  AksFileClass;
 
+typedef gboolean (*AksFileReadFunc) (const gchar  *path,
+                                     GBytes       *bytes,
+                                     gpointer      user_data);
+
 #if __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -93,8 +97,61 @@ aks_file_new_async(GInputStream        *base_stream,
                    GAsyncReadyCallback  callback,
                    gpointer             user_data);
 GFile*
+aks_file_new_for_file(GFile         *base_file,
+                      AksCacheLevel  cache_level,
+                      const gchar   *filename,
+                      GCancellable  *cancellable,
+                      GError       **error);
+void
+aks_file_new_for_file_async(GFile               *base_file,
+                            AksCacheLevel        cache_level,
+                            const gchar         *filename,
+                            int                  io_priority,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data);
+GFile*
 aks_file_new_finish(GAsyncResult   *res,
                     GError        **error);
+gboolean
+aks_file_pin(GFile         *file,
+             GCancellable  *cancellable,
+             GError       **error);
+gboolean
+aks_file_read_many(GFile               *file,
+                   const gchar* const  *paths,
+                   AksFileReadFunc      callback,
+                   gpointer             user_data,
+                   GCancellable        *cancellable,
+                   GError             **error);
+void
+aks_file_prefetch_async(GFile                  *file,
+                        const gchar* const     *paths,
+                        int                     io_priority,
+                        GCancellable           *cancellable,
+                        GFileProgressCallback   progress_callback,
+                        gpointer                progress_data,
+                        GAsyncReadyCallback     callback,
+                        gpointer                user_data);
+gboolean
+aks_file_prefetch_finish(GFile          *file,
+                         GAsyncResult   *res,
+                         GError        **error);
+void
+aks_file_unpin(GFile* file);
+void
+aks_file_set_shared_cache_budget(guint64 budget);
+GBytes*
+aks_stream_read_bytes(GInputStream   *stream,
+                      gsize           count,
+                      GCancellable   *cancellable,
+                      GError        **error);
+gssize
+aks_stream_splice(GOutputStream            *target,
+                  GInputStream             *source,
+                  GOutputStreamSpliceFlags  flags,
+                  GCancellable             *cancellable,
+                  GError                  **error);
 
 #if __cplusplus
 }
@@ -0,0 +1,356 @@
+/*  Copyright 2021-2022 MarcosHCK
+ *  This file is part of libakashic.
+ *
+ *  libakashic is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libakashic is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libakashic. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <aks_file_private.h>
+
+/*
+ * Readers pool
+ * Readers on the pool are left
+ * right past their entry header,
+ * so walking headers from there
+ * reaches any entry after it
+ *
+ */
+
+typedef struct _FileReader FileReader;
+
+struct _FileReader
+{
+  GObject* reader;
+  struct archive* ar;
+  gint row;
+};
+
+/*
+ * How many entries ahead an
+ * indexed archive reader is still
+ * worth walking to (further ones
+ * are opened at their offset)
+ *
+ */
+static
+const gint READER_REACH = 64;
+
+static void
+file_reader_free(FileReader* reader)
+{
+  _aks_archive_read_free(reader->reader, reader->ar);
+  g_object_unref(reader->reader);
+  g_slice_free(FileReader, reader);
+}
+
+FileArchive*
+_aks_file_archive_new()
+{
+  FileArchive* archive =
+  g_slice_new0(FileArchive);
+  g_atomic_ref_count_init(&(archive->refs));
+  g_queue_init(&(archive->idle_streams));
+  g_queue_init(&(archive->readers));
+  g_mutex_init(&(archive->readers_lock));
+  g_mutex_init(&(archive->stream_lock));
+  g_cond_init(&(archive->stream_cond));
+return archive;
+}
+
+FileArchive*
+_aks_file_archive_ref(FileArchive* archive)
+{
+  g_atomic_ref_count_inc(&(archive->refs));
+return archive;
+}
+
+static void
+dispose_node(FileNode* node) {
+
+/*
+ * Unref data
+ *
+ */
+  g_clear_pointer
+  (&(node->data),
+   _aks_node_data_unref);
+
+/*
+ * Dispose node children
+ *
+ */
+  g_node_children_foreach
+  (&(node->node_),
+   G_TRAVERSE_ALL,
+   (GNodeForeachFunc)
+   dispose_node,
+   NULL);
+}
+
+void
+_aks_file_archive_unref(FileArchive* archive)
+{
+  if(g_atomic_ref_count_dec(&(archive->refs)))
+  {
+  /*
+   * Pooled readers use archive
+   * (stream, mapping, checkpoints)
+   * so they go first
+   *
+   */
+    g_queue_clear_full(&(archive->readers), (GDestroyNotify) file_reader_free);
+    g_mutex_clear(&(archive->readers_lock));
+
+    g_clear_pointer(&(archive->nodes), g_hash_table_unref);
+    if G_LIKELY(archive->root != NULL)
+    {
+      dispose_node(archive->root);
+      g_node_destroy(&(archive->root->node_));
+    }
+
+  /*
+   * Cached entries refer to
+   * node data, whose names
+   * live on entries table
+   *
+   */
+    g_clear_pointer(&(archive->cache), _aks_cache_unref);
+    g_clear_pointer(&(archive->entries), _aks_entry_table_unref);
+
+    g_queue_clear_full(&(archive->idle_streams), g_object_unref);
+    g_clear_object(&(archive->base_stream));
+    g_clear_object(&(archive->base_file));
+    g_clear_pointer(&(archive->mapped), g_bytes_unref);
+    g_clear_pointer(&(archive->gzip), _aks_gzip_index_unref);
+    g_clear_pointer(&(archive->filters), g_array_unref);
+    g_strfreev(archive->allowed_formats);
+    g_strfreev(archive->allowed_filters);
+    g_free(archive->index_directory);
+    g_free(archive->identity);
+    g_mutex_clear(&(archive->stream_lock));
+    g_cond_clear(&(archive->stream_cond));
+    g_slice_free(FileArchive, archive);
+  }
+}
+
+static void
+wake_stream_waiters(GCancellable   *cancellable,
+                    FileArchive    *archive)
+{
+  g_mutex_lock(&(archive->stream_lock));
+  g_cond_broadcast(&(archive->stream_cond));
+  g_mutex_unlock(&(archive->stream_lock));
+}
+
+GInputStream*
+_aks_file_archive_acquire_stream(FileArchive    *archive,
+                                 GCancellable   *cancellable,
+                                 GError        **error)
+{
+  GInputStream* stream = NULL;
+  GError* tmp_err = NULL;
+  gboolean open = FALSE;
+  gulong handler = 0;
+
+/*
+ * Cancelling wakes waiters up
+ * (connected before locking, as
+ * handler runs right away if
+ * already cancelled)
+ *
+ */
+  if(cancellable != NULL)
+  {
+    handler =
+    g_cancellable_connect
+    (cancellable,
+     G_CALLBACK(wake_stream_waiters),
+     archive,
+     NULL);
+  }
+
+  g_mutex_lock(&(archive->stream_lock));
+  for(;;)
+  {
+    stream =
+    g_queue_pop_head
+    (&(archive->idle_streams));
+    if(stream != NULL)
+      break;
+
+  /*
+   * Release signal may have woken
+   * us instead of someone else,
+   * so pass it on
+   *
+   */
+    if(g_cancellable_set_error_if_cancelled(cancellable, &tmp_err))
+    {
+      g_cond_signal(&(archive->stream_cond));
+      break;
+    }
+
+  /*
+   * Every stream is busy, open
+   * another one if we are allowed
+   * to (outside lock, it may take
+   * a while), wait for one to be
+   * released otherwise
+   *
+   */
+    if(archive->base_file != NULL
+       && archive->n_streams < archive->max_readers)
+    {
+      archive->n_streams++;
+      open = TRUE;
+      break;
+    }
+
+    g_cond_wait
+    (&(archive->stream_cond),
+     &(archive->stream_lock));
+  }
+
+  g_mutex_unlock(&(archive->stream_lock));
+  g_cancellable_disconnect(cancellable, handler);
+
+  if(open == TRUE)
+  {
+    stream = (GInputStream*)
+    g_file_read
+    (archive->base_file,
+     cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_mutex_lock(&(archive->stream_lock));
+      archive->n_streams--;
+      g_cond_signal(&(archive->stream_cond));
+      g_mutex_unlock(&(archive->stream_lock));
+    }
+  }
+
+  if G_UNLIKELY(tmp_err != NULL)
+    g_propagate_error(error, tmp_err);
+return stream;
+}
+
+void
+_aks_file_archive_release_stream(FileArchive    *archive,
+                                 GInputStream   *stream)
+{
+  g_mutex_lock(&(archive->stream_lock));
+  g_queue_push_head(&(archive->idle_streams), stream);
+  g_cond_signal(&(archive->stream_cond));
+  g_mutex_unlock(&(archive->stream_lock));
+}
+
+struct archive*
+_aks_file_archive_take_reader(FileArchive    *archive,
+                              gint            row,
+                              GObject       **preader)
+{
+  FileReader* best = NULL;
+  struct archive* ar = NULL;
+  GList* list;
+
+  g_mutex_lock(&(archive->readers_lock));
+
+/*
+ * Nearest reader which
+ * hasn't gone past wanted
+ * entry yet
+ *
+ */
+  for(list = archive->readers.head;
+      list != NULL;
+      list = list->next)
+  {
+    FileReader* reader = list->data;
+    if(reader->row < row
+       && (best == NULL || reader->row > best->row))
+      best = reader;
+  }
+
+  if(best != NULL
+     && archive->indexed == TRUE
+     && row - best->row > READER_REACH)
+    best = NULL;
+
+  if(best != NULL)
+    g_queue_remove(&(archive->readers), best);
+
+  g_mutex_unlock(&(archive->readers_lock));
+
+  if(best != NULL)
+  {
+    ar = best->ar;
+    *preader = best->reader;
+    g_slice_free(FileReader, best);
+  }
+return ar;
+}
+
+void
+_aks_file_archive_give_reader(FileArchive      *archive,
+                              GObject          *reader,
+                              struct archive   *ar,
+                              gint              row)
+{
+  FileReader* reader_ =
+  g_slice_new(FileReader);
+  reader_->reader = reader;
+  reader_->ar = ar;
+  reader_->row = row;
+
+  _aks_archive_set_cancellable
+  (reader,
+   ar,
+   NULL);
+
+/*
+ * Full pool drops its
+ * farthest behind reader
+ *
+ */
+  g_mutex_lock(&(archive->readers_lock));
+  g_queue_push_head(&(archive->readers), reader_);
+
+  if(archive->readers.length > MAX(archive->max_readers, 1))
+  {
+    GList* list;
+
+    reader_ = NULL;
+    for(list = archive->readers.head;
+        list != NULL;
+        list = list->next)
+    {
+      FileReader* other = list->data;
+      if(reader_ == NULL || other->row < reader_->row)
+        reader_ = other;
+    }
+
+    g_queue_remove(&(archive->readers), reader_);
+  }
+  else
+  {
+    reader_ = NULL;
+  }
+
+  g_mutex_unlock(&(archive->readers_lock));
+
+  if(reader_ != NULL)
+    file_reader_free(reader_);
+}
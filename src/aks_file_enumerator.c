@@ -58,7 +58,7 @@ aks_file_enumerator_class_next_file(GFileEnumerator  *pself,
     return NULL;
 
   if G_UNLIKELY
-    (node->data->entry == NULL)
+    (node->data->entry < 0)
   {
     g_set_error
     (error,
@@ -68,9 +68,14 @@ aks_file_enumerator_class_next_file(GFileEnumerator  *pself,
     goto_error();
   }
 
+  AksFile* file = (AksFile*)
+  g_file_enumerator_get_container(pself);
+
   info =
   _aks_file_info_get
-  (node->data->entry,
+  (_aks_entry_table_get
+   (file->archive->entries,
+    node->data->entry),
    self->matcher,
    self->flags,
    &tmp_err);
@@ -142,19 +147,19 @@ _aks_file_enumerator_new(AksFile *file_,
                          GCancellable *cancellable,
                          GError **error)
 {
-  AksFile* file = (AksFile*)
-  g_file_dup(G_FILE(file_));
-
   AksFileEnumerator* thi5 =
   g_object_new
   (AKS_TYPE_FILE_ENUMERATOR,
    "container", file_,
    NULL);
 
-  thi5->node = file->current->children;
+/*
+ * Container keeps archive
+ * tree alive
+ *
+ */
+  thi5->node = file_->current->children;
   thi5->matcher = g_file_attribute_matcher_new(attributes);
   thi5->flags = flags;
-
-  g_object_unref(file);
 return G_FILE_ENUMERATOR(thi5);
 }
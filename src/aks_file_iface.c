@@ -34,35 +34,23 @@ aks_file_g_file_iface_dup(GFile* pself) {
   g_object_new
   (AKS_TYPE_FILE,
    "dup", TRUE,
-   "base-stream", self->base_stream,
-   "cache-level", self->cache_level,
    "filename", self->filename,
    NULL);
 
 /*
- * Copy entry tree
+ * Copies are just another
+ * view of same archive
  *
  */
-  dst->root =
-  (FileNode*)
-  g_node_copy_deep
-  (&(self->root->node_),
-   (GCopyFunc)
-   _aks_node_data_ref,
-   NULL);
+  _aks_file_archive_unref(dst->archive);
+  dst->archive =
+  _aks_file_archive_ref(self->archive);
 
 /*
  * Unfreeze notifications
  *
  */
   g_object_thaw_notify(G_OBJECT(dst));
-
-/*
- * Copy other data
- *
- */
-  dst->start_position = self->start_position;
-  dst->current = self->current;
 return G_FILE(dst);
 }
 
@@ -79,13 +67,16 @@ aks_file_g_file_iface_equal(GFile* pself1,
   AksFile* self1 = AKS_FILE(pself1);
   AksFile* self2 = AKS_FILE(pself2);
 
+/*
+ * Copies share their
+ * archive tree, so nodes
+ * can be told apart
+ * by address
+ *
+ */
   return
-  (self1->base_stream == self2->base_stream
-   && self1->current == self1->current
-   && (self1->current == NULL
-       || _aks_node_data_equal
-          (self1->current->data,
-           self2->current->data)));
+  (self1->archive == self2->archive
+   && self1->current == self2->current);
 }
 
 gboolean
@@ -250,65 +241,203 @@ _error_:
 return enumerator;
 }
 
-static GInputStream*
-peek_stream(AksFile* self,
-            struct archive_entry* entry,
-            GCancellable   *cancellable,
-            GError        **error)
-{
-  GInputStream* stream = NULL;
-  gboolean success = TRUE;
-  GError* tmp_err = NULL;
-
 /*
- * Reset stream
+ * Every read gets its own
+ * source object, so reader
+ * state never collides with
+ * concurrent reads on same
+ * file object; readers are
+ * taken from (and given back
+ * to) archive pool when
+ * possible
  *
  */
-  g_seekable_seek
-  (G_SEEKABLE(self->base_stream),
-   self->start_position,
-   G_SEEK_SET,
-   cancellable,
-   &tmp_err);
 
-  if G_UNLIKELY(tmp_err != NULL)
+struct archive*
+_aks_file_open_entry(FileArchive    *archive,
+                     FileNodeData   *data,
+                     GObject       **preader,
+                     GCancellable   *cancellable,
+                     GError        **error)
+{
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  GObject* reader = NULL;
+  struct archive* ar = NULL;
+  goffset offset = -1;
+
+  if G_UNLIKELY(data->entry < 0)
   {
-    g_propagate_error(error, tmp_err);
+    g_set_error
+    (error,
+     G_IO_ERROR,
+     G_IO_ERROR_INVAL,
+     "invalid file\r\n");
     return NULL;
   }
 
+  FileEntry* entry =
+  _aks_entry_table_get
+  (archive->entries,
+   data->entry);
+
 /*
- * Make archive
+ * Start right at entry
+ * header if possible
  *
  */
-  struct archive* ar =
-  _aks_archive_read_make
-  (G_OBJECT(self),
-   self->base_stream,
-   cancellable,
-   &tmp_err);
+  if(archive->indexed == TRUE)
+    offset = entry->offset;
 
-  if G_UNLIKELY(tmp_err != NULL)
+/*
+ * Carry on from a reader
+ * left before entry
+ *
+ */
+  ar =
+  _aks_file_archive_take_reader
+  (archive,
+   data->entry,
+   &reader);
+
+  if(ar != NULL)
   {
-    g_propagate_error(error, tmp_err);
-    goto_error();
+    _aks_archive_set_cancellable
+    (reader,
+     ar,
+     cancellable);
+
+    _aks_archive_read_skip_til_entry
+    (reader,
+     ar,
+     entry->pathname,
+     cancellable,
+     &tmp_err);
+
+    if G_LIKELY(tmp_err == NULL)
+      goto _error_;
+
+    _aks_archive_read_free(reader, ar);
+    g_clear_object(&reader);
+    ar = NULL;
+
+    if(g_error_matches
+       (tmp_err,
+        G_IO_ERROR,
+        G_IO_ERROR_CANCELLED))
+    {
+      g_propagate_error(error, tmp_err);
+      goto_error();
+    }
+
+    g_clear_error(&tmp_err);
   }
 
+  reader =
+  g_object_new(G_TYPE_OBJECT, NULL);
+
+  for(;;)
+  {
+  /*
+   * Make archive
+   *
+   */
+    ar =
+    _aks_archive_read_make
+    (reader,
+     archive,
+     offset,
+     cancellable,
+     &tmp_err);
+
+  /*
+   * Search entry
+   *
+   */
+    if G_LIKELY(tmp_err == NULL)
+    _aks_archive_read_skip_til_entry
+    (reader,
+     ar,
+     entry->pathname,
+     cancellable,
+     &tmp_err);
+
+    if G_LIKELY(tmp_err == NULL)
+      break;
+
+    if G_UNLIKELY(ar != NULL)
+      _aks_archive_read_free
+      (reader,
+       ar);
+    ar = NULL;
+
+  /*
+   * Entry wasn't where index said
+   * (names recorded differently, for
+   * instance), walk archive instead
+   *
+   */
+    if(offset < 0
+       || g_error_matches
+          (tmp_err,
+           G_IO_ERROR,
+           G_IO_ERROR_CANCELLED))
+    {
+      g_propagate_error(error, tmp_err);
+      goto_error();
+    }
+
+    g_clear_error(&tmp_err);
+    offset = -1;
+  }
+
+_error_:
+  if G_UNLIKELY(success == FALSE)
+    g_clear_object(&reader);
+  *preader = reader;
+return ar;
+}
+
+void
+_aks_file_close_entry(FileArchive      *archive,
+                      FileNodeData     *data,
+                      GObject          *reader,
+                      struct archive   *ar)
+{
+  _aks_file_archive_give_reader
+  (archive,
+   reader,
+   ar,
+   data->entry);
+}
+
+static GInputStream*
+peek_stream(AksFile        *self,
+            FileNodeData   *data,
+            GCancellable   *cancellable,
+            GError        **error)
+{
+  GInputStream* stream = NULL;
+  GError* tmp_err = NULL;
+
 /*
- * Search entry
+ * Open entry
  *
  */
-  _aks_archive_read_skip_til_entry
-  (G_OBJECT(self),
-   ar,
-   entry,
+  GObject* reader = NULL;
+
+  struct archive* ar =
+  _aks_file_open_entry
+  (self->archive,
+   data,
+   &reader,
    cancellable,
    &tmp_err);
 
   if G_UNLIKELY(tmp_err != NULL)
   {
     g_propagate_error(error, tmp_err);
-    goto_error();
+    return NULL;
   }
 
 /*
@@ -319,28 +448,22 @@ peek_stream(AksFile* self,
   g_object_new
   (AKS_TYPE_STREAM,
    "archive", ar,
+   "file-archive", self->archive,
+   "node-data", data,
    NULL);
 
   _aks_archive_switch_source_object
-  (G_OBJECT(self),
+  (reader,
    G_OBJECT(stream),
    ar);
 
-_error_:
-  if G_UNLIKELY(success == FALSE)
-  {
-    g_clear_object(&stream);
-    if G_UNLIKELY(ar != NULL)
-      _aks_archive_read_free
-      (G_OBJECT(self),
-       ar);
-  }
+  g_object_unref(reader);
 return stream;
 }
 
 static GBytes*
-peek_bytes(AksFile* self,
-           struct archive_entry* entry,
+peek_bytes(AksFile        *self,
+           FileNodeData   *data,
            GCancellable   *cancellable,
            GError        **error)
 {
@@ -349,30 +472,36 @@ peek_bytes(AksFile* self,
   GBytes* bytes = NULL;
 
 /*
- * Reset stream
+ * Open entry
  *
  */
-  g_seekable_seek
-  (G_SEEKABLE(self->base_stream),
-   self->start_position,
-   G_SEEK_SET,
+  GObject* reader = NULL;
+
+  struct archive* ar =
+  _aks_file_open_entry
+  (self->archive,
+   data,
+   &reader,
    cancellable,
    &tmp_err);
 
   if G_UNLIKELY(tmp_err != NULL)
   {
     g_propagate_error(error, tmp_err);
-    return NULL;
+    goto_error();
   }
 
 /*
- * Make archive
+ * Dump data
  *
  */
-  struct archive* ar =
-  _aks_archive_read_make
-  (G_OBJECT(self),
-   self->base_stream,
+  bytes =
+  _aks_archive_dump_to_bytes
+  (reader,
+   ar,
+   _aks_entry_table_get
+   (self->archive->entries,
+    data->entry)->size,
    cancellable,
    &tmp_err);
 
@@ -382,47 +511,221 @@ peek_bytes(AksFile* self,
     goto_error();
   }
 
+_error_:
+  if G_UNLIKELY(success == FALSE)
+    g_clear_pointer(&bytes, g_bytes_unref);
+  if G_LIKELY(ar != NULL)
+  {
+  /*
+   * Failed readers are
+   * not worth keeping
+   *
+   */
+    if G_LIKELY(success == TRUE)
+    {
+      _aks_file_close_entry
+      (self->archive,
+       data,
+       reader,
+       ar);
+    } else
+    {
+      _aks_archive_read_free(reader, ar);
+      g_object_unref(reader);
+    }
+  }
+return bytes;
+}
+
+GBytes*
+_aks_file_lookup_bytes(AksFile        *self,
+                       FileNodeData   *data)
+{
+  GBytes* bytes = NULL;
+
 /*
- * Search entry
+ * Fully cached contents (either
+ * in memory or spilled to disk)
+ * never go away
  *
  */
-  _aks_archive_read_skip_til_entry
-  (G_OBJECT(self),
-   ar,
-   entry,
-   cancellable,
-   &tmp_err);
+  switch(self->archive->cache_level)
+  {
+  case AKS_CACHE_LEVEL_NONE:
+    break;
+  case AKS_CACHE_LEVEL_FULL:
+  case AKS_CACHE_LEVEL_DISK:
+    if G_LIKELY(data->cache != NULL)
+      bytes = g_bytes_ref(data->cache);
+    break;
+  case AKS_CACHE_LEVEL_OTF:
+    {
+      gchar* key =
+      _aks_shared_cache_key(self->archive, data);
 
-  if G_UNLIKELY(tmp_err != NULL)
+      bytes = (key != NULL)
+      ? _aks_shared_cache_lookup(key)
+      : _aks_cache_lookup(self->archive->cache, data);
+      g_free(key);
+    }
+    break;
+  }
+return bytes;
+}
+
+GBytes*
+_aks_file_store_bytes(AksFile        *self,
+                      FileNodeData   *data,
+                      GBytes         *bytes)
+{
+  if(self->archive->cache_level == AKS_CACHE_LEVEL_OTF)
   {
-    g_propagate_error(error, tmp_err);
-    goto_error();
+    gchar* key =
+    _aks_shared_cache_key(self->archive, data);
+
+    bytes = (key != NULL)
+    ? _aks_shared_cache_insert(key, bytes)
+    : _aks_cache_insert(self->archive->cache, data, bytes);
+    g_free(key);
   }
+return bytes;
+}
 
 /*
- * Dump data
+ * Fill claims go where contents
+ * go, so objects sharing cache
+ * also share who decodes what
  *
  */
-  bytes =
-  _aks_archive_dump_to_bytes
-  (G_OBJECT(self),
-   ar,
-   cancellable,
-   &tmp_err);
 
-  if G_UNLIKELY(tmp_err != NULL)
+gboolean
+_aks_file_claim(AksFile        *self,
+                FileNodeData   *data)
+{
+  gboolean claimed;
+  gchar* key =
+  _aks_shared_cache_key(self->archive, data);
+
+  claimed = (key != NULL)
+  ? _aks_shared_cache_claim(key)
+  : _aks_cache_claim(self->archive->cache, data);
+  g_free(key);
+return claimed;
+}
+
+GBytes*
+_aks_file_wait(AksFile        *self,
+               FileNodeData   *data,
+               GCancellable   *cancellable,
+               GError        **error)
+{
+  GBytes* bytes;
+  gchar* key =
+  _aks_shared_cache_key(self->archive, data);
+
+  bytes = (key != NULL)
+  ? _aks_shared_cache_wait(key, cancellable, error)
+  : _aks_cache_wait(self->archive->cache, data, cancellable, error);
+  g_free(key);
+return bytes;
+}
+
+void
+_aks_file_release(AksFile        *self,
+                  FileNodeData   *data,
+                  GBytes         *bytes)
+{
+  gchar* key =
+  _aks_shared_cache_key(self->archive, data);
+
+  if(key != NULL)
+    _aks_shared_cache_release(key, bytes);
+  else
+    _aks_cache_release(self->archive->cache, data, bytes);
+  g_free(key);
+}
+
+GBytes*
+_aks_file_get_bytes(AksFile        *self,
+                    FileNodeData   *data,
+                    GCancellable   *cancellable,
+                    GError        **error)
+{
+  GError* tmp_err = NULL;
+  GBytes* bytes = NULL;
+
+  if G_UNLIKELY
+    (self->archive->cache_level == AKS_CACHE_LEVEL_FULL
+     || self->archive->cache_level == AKS_CACHE_LEVEL_DISK)
   {
-    g_propagate_error(error, tmp_err);
-    goto_error();
+    bytes =
+    _aks_file_lookup_bytes(self, data);
+    if G_UNLIKELY(bytes == NULL)
+    {
+      g_set_error
+      (error,
+       G_IO_ERROR,
+       G_IO_ERROR_INVAL,
+       "invalid file\r\n");
+      return NULL;
+    }
+    return bytes;
   }
 
-_error_:
-  if G_UNLIKELY(success == FALSE)
-    g_clear_pointer(&bytes, g_bytes_unref);
-  if G_UNLIKELY(ar != NULL)
-    _aks_archive_read_free
-    (G_OBJECT(self),
-     ar);
+/*
+ * Only the first reader of an
+ * uncached entry decodes it, the
+ * rest wait for its contents (and
+ * try themselves if it failed)
+ *
+ */
+  for(;;)
+  {
+    bytes =
+    _aks_file_lookup_bytes(self, data);
+    if(bytes != NULL)
+      break;
+
+    if(_aks_file_claim(self, data) == FALSE)
+    {
+      bytes = _aks_file_wait(self, data, cancellable, &tmp_err);
+      if G_UNLIKELY(tmp_err != NULL)
+      {
+        g_propagate_error(error, tmp_err);
+        return NULL;
+      }
+
+      if(bytes != NULL)
+        break;
+      continue;
+    }
+
+  /*
+   * Someone may have stored it
+   * right before we claimed it
+   *
+   */
+    bytes =
+    _aks_file_lookup_bytes(self, data);
+    if(bytes == NULL)
+    {
+      bytes = peek_bytes(self, data, cancellable, &tmp_err);
+      if G_LIKELY(tmp_err == NULL)
+      {
+        bytes =
+        _aks_file_store_bytes(self, data, bytes);
+      }
+    }
+
+    _aks_file_release(self, data, bytes);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      return NULL;
+    }
+    break;
+  }
 return bytes;
 }
 
@@ -447,12 +750,12 @@ aks_file_g_file_iface_read_fn(GFile          *pself,
     goto_error();
   }
 
-  switch(self->cache_level)
+  switch(self->archive->cache_level)
   {
   case AKS_CACHE_LEVEL_NONE:
     {
       result =
-      peek_stream(self, node->data->entry, cancellable, &tmp_err);
+      peek_stream(self, node->data, cancellable, &tmp_err);
       if G_UNLIKELY(tmp_err != NULL)
       {
         g_propagate_error(error, tmp_err);
@@ -462,34 +765,19 @@ aks_file_g_file_iface_read_fn(GFile          *pself,
     break;
   case AKS_CACHE_LEVEL_OTF:
   case AKS_CACHE_LEVEL_FULL:
+  case AKS_CACHE_LEVEL_DISK:
     {
-      GBytes* bytes = node->data->cache;
-      if G_UNLIKELY(bytes == NULL)
+      GBytes* bytes =
+      _aks_file_get_bytes(self, node->data, cancellable, &tmp_err);
+      if G_UNLIKELY(tmp_err != NULL)
       {
-        if G_UNLIKELY
-          (self->cache_level == AKS_CACHE_LEVEL_FULL
-           || node->data->entry == NULL)
-        {
-          g_set_error
-          (error,
-           G_IO_ERROR,
-           G_IO_ERROR_INVAL,
-           "invalid file\r\n");
-          goto_error();
-        }
-
-        bytes = peek_bytes(self, node->data->entry, cancellable, &tmp_err);
-        if G_UNLIKELY(tmp_err != NULL)
-        {
-          g_propagate_error(error, tmp_err);
-          goto_error();
-        }
-
-        node->data->cache = bytes;
+        g_propagate_error(error, tmp_err);
+        goto_error();
       }
 
       result = (GInputStream*)
       g_memory_input_stream_new_from_bytes(bytes);
+      g_bytes_unref(bytes);
     }
     break;
   }
@@ -515,7 +803,7 @@ aks_file_g_file_iface_query_info(GFile               *pself,
   FileNode* node = self->current;
   if G_UNLIKELY
     (node == NULL
-     || node->data->entry == NULL)
+     || node->data->entry < 0)
   {
     g_set_error
     (error,
@@ -531,7 +819,9 @@ aks_file_g_file_iface_query_info(GFile               *pself,
 
   info =
   _aks_file_info_get
-  (node->data->entry,
+  (_aks_entry_table_get
+   (self->archive->entries,
+    node->data->entry),
    matcher,
    flags,
    &tmp_err);
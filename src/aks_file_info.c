@@ -21,11 +21,11 @@
 #include <inttypes.h>
 
 static void
-set_file_type(GFileInfo              *info,
-              struct archive_entry   *entry)
+set_file_type(GFileInfo          *info,
+              const FileEntry    *entry)
 {
   mode_t mode = (mode_t)
-  archive_entry_mode(entry);
+  entry->mode;
   GFileType type = G_FILE_TYPE_UNKNOWN;
 
   if(__S_ISTYPE(mode, AE_IFREG))
@@ -48,7 +48,7 @@ set_file_type(GFileInfo              *info,
     (info,
      G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET,
      (const char*)
-     archive_entry_symlink(entry));
+     entry->symlink);
 
   g_file_info_set_attribute_uint32
   (info,
@@ -57,7 +57,7 @@ set_file_type(GFileInfo              *info,
 }
 
 GFileInfo*
-_aks_file_info_get(struct archive_entry      *entry,
+_aks_file_info_get(const FileEntry           *entry,
                    GFileAttributeMatcher     *matcher,
                    GFileAttributeInfoFlags    flags,
                    GError                   **error)
@@ -68,7 +68,9 @@ _aks_file_info_get(struct archive_entry      *entry,
 
   gchar* basename =
   g_path_get_basename
-  (archive_entry_pathname_utf8(entry));
+  ((entry->pathname_utf8 != NULL)
+   ? entry->pathname_utf8
+   : entry->pathname);
 
 /*
  * Prepare info
@@ -90,7 +92,7 @@ _aks_file_info_get(struct archive_entry      *entry,
   (info,
    G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE,
    (guint64)
-   archive_entry_size(entry));
+   entry->size);
 
   g_file_info_set_attribute_string
   (info,
@@ -130,7 +132,7 @@ _aks_file_info_get(struct archive_entry      *entry,
   g_file_info_set_attribute_boolean
   (info,
    G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK,
-   archive_entry_mode(entry) & AE_IFLNK);
+   entry->mode & AE_IFLNK);
 
   g_file_info_set_attribute_boolean
   (info,
@@ -151,7 +153,7 @@ _aks_file_info_get(struct archive_entry      *entry,
   (info,
    G_FILE_ATTRIBUTE_STANDARD_SIZE,
    (guint64)
-   archive_entry_size(entry));
+   entry->size);
 
   set_file_type(info, entry);
   g_free(basename);
@@ -165,45 +167,45 @@ _aks_file_info_get(struct archive_entry      *entry,
   (info,
    G_FILE_ATTRIBUTE_TIME_ACCESS,
    (guint64)
-   archive_entry_atime(entry));
+   entry->atime);
   g_file_info_set_attribute_uint32
   (info,
    G_FILE_ATTRIBUTE_TIME_ACCESS_USEC,
    (guint32)
-   archive_entry_atime_nsec(entry));
+   entry->atime_nsec);
 
   g_file_info_set_attribute_uint64
   (info,
    G_FILE_ATTRIBUTE_TIME_CREATED,
    (guint64)
-   archive_entry_birthtime(entry));
+   entry->birthtime);
   g_file_info_set_attribute_uint32
   (info,
    G_FILE_ATTRIBUTE_TIME_CREATED_USEC,
    (guint32)
-   archive_entry_birthtime_nsec(entry));
+   entry->birthtime_nsec);
 
   g_file_info_set_attribute_uint64
   (info,
    G_FILE_ATTRIBUTE_TIME_CHANGED,
    (guint64)
-   archive_entry_ctime(entry));
+   entry->ctime);
   g_file_info_set_attribute_uint32
   (info,
    G_FILE_ATTRIBUTE_TIME_CHANGED_USEC,
    (guint32)
-   archive_entry_ctime_nsec(entry));
+   entry->ctime_nsec);
 
   g_file_info_set_attribute_uint64
   (info,
    G_FILE_ATTRIBUTE_TIME_MODIFIED,
    (guint64)
-   archive_entry_mtime(entry));
+   entry->mtime);
   g_file_info_set_attribute_uint32
   (info,
    G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
    (guint32)
-   archive_entry_mtime_nsec(entry));
+   entry->mtime_nsec);
 
 _error_:
   if G_LIKELY(success == TRUE)
@@ -17,15 +17,14 @@
  */
 #ifndef __LIBAKASHIC_AKS_FILE_INFO__
 #define __LIBAKASHIC_AKS_FILE_INFO__
-#include <archive_entry.h>
-#include <gio/gio.h>
+#include <aks_file_private.h>
 
 #if __cplusplus
 extern "C" {
 #endif // __cplusplus
 
 GFileInfo*
-_aks_file_info_get(struct archive_entry      *entry,
+_aks_file_info_get(const FileEntry           *entry,
                    GFileAttributeMatcher     *matcher,
                    GFileAttributeInfoFlags    flags,
                    GError                   **error);
@@ -22,13 +22,14 @@ FileNodeData*
 _aks_node_data_new() {
   FileNodeData* data =
   g_slice_new0(FileNodeData);
-  g_ref_count_init(&(data->refs));
+  g_atomic_ref_count_init(&(data->refs));
+  data->entry = -1;
 return data;
 }
 
 FileNodeData*
 _aks_node_data_ref(FileNodeData* data) {
-  g_ref_count_inc(&(data->refs));
+  g_atomic_ref_count_inc(&(data->refs));
 return data;
 }
 
@@ -37,16 +38,15 @@ _aks_node_data_unref(FileNodeData* data) {
   if G_LIKELY(data != NULL)
   {
     gboolean zero =
-    g_ref_count_dec(&(data->refs));
+    g_atomic_ref_count_dec(&(data->refs));
     if(zero == TRUE)
     {
     /*
      * Free data
      *
      */
-      g_clear_pointer(&(data->entry), archive_entry_free);
       g_clear_pointer(&(data->cache), g_bytes_unref);
-      g_clear_pointer(&(data->name), g_free);
+      g_clear_pointer(&(data->fill), g_bytes_unref);
 
     /*
      * Free data structure
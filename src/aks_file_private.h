@@ -24,6 +24,16 @@
 typedef union  _FileNode      FileNode;
 typedef struct _FileNodeData  FileNodeData;
 typedef guint                 FileNodeHash;
+typedef struct _GzipIndex     GzipIndex;
+typedef struct _GzipReader    GzipReader;
+typedef struct _FileCache     FileCache;
+typedef struct _FileEntry     FileEntry;
+typedef struct _EntryTable    EntryTable;
+typedef struct _FileArchive   FileArchive;
+typedef void (*ZipEntryFunc) (const gchar* name, goffset offset, gpointer user_data);
+typedef void (*IndexEntryFunc) (const FileEntry* entry, gpointer user_data);
+
+#define GZIP_INDEX_TYPE "a(xxyay)"
 
 #define goto_error() \
 G_STMT_START { \
@@ -38,18 +48,156 @@ extern "C" {
 GType
 _aks_node_data_get_type();
 
-struct _AksFile
+/*
+ * Entry metadata, kept on a
+ * table row (strings live on
+ * table string pool); UTF-8
+ * pathname is NULL when it
+ * couldn't be converted, and
+ * same string as pathname
+ * when it needed no conversion;
+ * size is zero when archive
+ * doesn't tell it (size_set)
+ *
+ */
+struct _FileEntry
 {
-  GObject parent_instance;
+  const gchar* pathname;
+  const gchar* pathname_utf8;
+  const gchar* symlink;
+  gint64 size;
+  gboolean size_set;
+  gint64 atime;
+  gint64 birthtime;
+  gint64 ctime;
+  gint64 mtime;
+  gint32 atime_nsec;
+  gint32 birthtime_nsec;
+  gint32 ctime_nsec;
+  gint32 mtime_nsec;
+  guint32 mode;
 
-  /*<private>*/
+  /*
+   * Header offset from
+   * archive start (-1
+   * if unknown)
+   *
+   */
+  goffset offset;
+};
+
+/*
+ * Archive wide state, shared
+ * by an object and every copy
+ * of it (which are just views
+ * of a node in it)
+ *
+ */
+struct _FileArchive
+{
+  gatomicrefcount refs;
   GInputStream* base_stream;
   AksCacheLevel cache_level;
-  gchar* filename;
-  FileNode* current;
+  guint block_size;
+
+  /*
+   * Source file, if any, and
+   * streams opened on it up to
+   * max_readers (base stream is
+   * one of them), each handed
+   * to one reader at a time when
+   * input can't be read at an
+   * offset directly
+   *
+   */
+  GFile* base_file;
+  guint max_readers;
+  guint n_streams;
+  GQueue idle_streams;
+  GMutex stream_lock;
+  GCond stream_cond;
+
+  /*
+   * Idle libarchive readers (up
+   * to max_readers too), each one
+   * left past an entry, so reads
+   * of entries further on can
+   * carry on from them
+   *
+   */
+  GQueue readers;
+  GMutex readers_lock;
 
   goffset start_position;
-  gboolean dup;
+  GBytes* mapped;
+
+  /*
+   * Archive format as detected
+   * on initialization, entries can
+   * be read directly from their
+   * header offset if indexed
+   *
+   */
+  int format;
+  gboolean indexed;
+
+  /*
+   * Formats and filters readers
+   * may bid for until format is
+   * known (NULL means any), and
+   * filter chain detected on
+   * exploration (NULL if
+   * unknown)
+   *
+   */
+  gchar** allowed_formats;
+  gchar** allowed_filters;
+  GArray* filters;
+
+  /*
+   * On-disk index location
+   * (NULL if disabled) and
+   * archive identity it is
+   * keyed by
+   *
+   */
+  gchar* index_directory;
+  gchar* identity;
+
+  /*
+   * Decompressor checkpoints
+   * for gzip archives (NULL
+   * if disabled or archive
+   * is something else)
+   *
+   */
+  guint64 checkpoint_interval;
+  GzipIndex* gzip;
+
+  /*
+   * On-the-fly cache, shared
+   * with copies (zero budget
+   * means unbounded), or
+   * process-wide one
+   *
+   */
+  guint64 cache_budget;
+  FileCache* cache;
+  gboolean shared_cache;
+
+  /*
+   * Entries metadata, shared
+   * with copies
+   *
+   */
+  EntryTable* entries;
+
+  /*
+   * Every node but root, keyed
+   * by parent node and name
+   *
+   */
+  GHashTable* nodes;
 
   union _FileNode
   {
@@ -58,21 +206,37 @@ struct _AksFile
     {
       struct _FileNodeData
       {
-        grefcount refs;
+        gatomicrefcount refs;
 
       /*
-       * ID
+       * ID (name is interned
+       * on entries table)
        *
        */
-        gchar* name;
+        const gchar* name;
         guint hash_;
 
       /*
-       * Cache
+       * Entries table row
+       * (-1 if none)
+       *
+       */
+        gint entry;
+
+      /*
+       * Cache (filling is set
+       * while someone decodes
+       * contents for it, which
+       * are handed to its waiters
+       * through fill)
        *
        */
         GBytes* cache;
-        struct archive_entry* entry;
+        GList lru;
+        guint pins;
+        gboolean filling;
+        guint waiters;
+        GBytes* fill;
       } *data;
 
       FileNode* next;
@@ -83,6 +247,40 @@ struct _AksFile
   } *root;
 };
 
+struct _AksFile
+{
+  GObject parent_instance;
+
+  /*<private>*/
+  FileArchive* archive;
+  gchar* filename;
+  FileNode* current;
+  gboolean dup;
+};
+
+FileArchive*
+_aks_file_archive_new();
+FileArchive*
+_aks_file_archive_ref(FileArchive* archive);
+void
+_aks_file_archive_unref(FileArchive* archive);
+GInputStream*
+_aks_file_archive_acquire_stream(FileArchive    *archive,
+                                 GCancellable   *cancellable,
+                                 GError        **error);
+void
+_aks_file_archive_release_stream(FileArchive    *archive,
+                                 GInputStream   *stream);
+struct archive*
+_aks_file_archive_take_reader(FileArchive    *archive,
+                              gint            row,
+                              GObject       **preader);
+void
+_aks_file_archive_give_reader(FileArchive      *archive,
+                              GObject          *reader,
+                              struct archive   *ar,
+                              gint              row);
+
 FileNodeData*
 _aks_node_data_new();
 FileNodeData*
@@ -107,28 +305,228 @@ _aks_archive_switch_source_object(GObject         *old_source_object,
 void
 _aks_archive_read_free(GObject        *source_object,
                        struct archive *ar);
+GBytes*
+_aks_archive_map_stream(GInputStream   *stream,
+                        goffset         offset);
+gboolean
+_aks_archive_pread(FileArchive    *archive,
+                   goffset         offset,
+                   gpointer        buffer,
+                   gsize           size,
+                   gsize          *pread_,
+                   GCancellable   *cancellable,
+                   GError        **error);
+gboolean
+_aks_archive_read_at(FileArchive    *archive,
+                     goffset         offset,
+                     gpointer        buffer,
+                     gsize           size,
+                     GCancellable   *cancellable,
+                     GError        **error);
+goffset
+_aks_archive_get_size(FileArchive    *archive,
+                      GCancellable   *cancellable,
+                      GError        **error);
+gboolean
+_aks_archive_check_names(FileArchive    *archive,
+                         GError        **error);
 struct archive*
 _aks_archive_read_make(GObject        *source_object,
-                       GInputStream   *stream,
+                       FileArchive    *archive,
+                       goffset         offset,
                        GCancellable   *cancellable,
                        GError        **error);
 gboolean
-_aks_archive_read_skip_til_entry(GObject               *source_object,
-                                 struct archive        *ar,
-                                 struct archive_entry  *til,
-                                 GCancellable          *cancellable,
-                                 GError               **error);
+_aks_archive_read_skip_til_entry(GObject         *source_object,
+                                 struct archive  *ar,
+                                 const gchar     *name,
+                                 GCancellable    *cancellable,
+                                 GError         **error);
 gboolean
 _aks_archive_dump_to_stream(GObject         *source_object,
                             struct archive  *ar,
                             GOutputStream   *stream,
                             GCancellable    *cancellable,
                             GError         **error);
+gboolean
+_aks_archive_dump_to_fd(GObject         *source_object,
+                        struct archive  *ar,
+                        int              fd,
+                        goffset          base,
+                        goffset         *psize,
+                        GCancellable    *cancellable,
+                        GError         **error);
 GBytes*
 _aks_archive_dump_to_bytes(GObject         *source_object,
                            struct archive  *ar,
+                           gint64           size_hint,
                            GCancellable    *cancellable,
                            GError         **error);
+GBytes*
+_aks_archive_block_bytes(GObject       *source_object,
+                         const void    *block,
+                         gsize          size);
+
+gboolean
+_aks_zip_read_directory(FileArchive    *archive,
+                        ZipEntryFunc    func,
+                        gpointer        user_data,
+                        GCancellable   *cancellable,
+                        GError        **error);
+
+EntryTable*
+_aks_entry_table_new();
+EntryTable*
+_aks_entry_table_ref(EntryTable* table);
+void
+_aks_entry_table_unref(EntryTable* table);
+const gchar*
+_aks_entry_table_intern(EntryTable    *table,
+                        const gchar   *string);
+gint
+_aks_entry_table_insert(EntryTable        *table,
+                        gint               row,
+                        const FileEntry   *entry);
+FileEntry*
+_aks_entry_table_get(EntryTable  *table,
+                     gint         row);
+guint
+_aks_entry_table_get_length(EntryTable* table);
+void
+_aks_entry_from_archive(FileEntry              *entry,
+                        struct archive_entry   *archive_entry);
+
+struct archive*
+_aks_file_open_entry(FileArchive    *archive,
+                     FileNodeData   *data,
+                     GObject       **preader,
+                     GCancellable   *cancellable,
+                     GError        **error);
+void
+_aks_file_close_entry(FileArchive      *archive,
+                      FileNodeData     *data,
+                      GObject          *reader,
+                      struct archive   *ar);
+GBytes*
+_aks_file_lookup_bytes(AksFile        *self,
+                       FileNodeData   *data);
+GBytes*
+_aks_file_store_bytes(AksFile        *self,
+                      FileNodeData   *data,
+                      GBytes         *bytes);
+gboolean
+_aks_file_claim(AksFile        *self,
+                FileNodeData   *data);
+GBytes*
+_aks_file_wait(AksFile        *self,
+               FileNodeData   *data,
+               GCancellable   *cancellable,
+               GError        **error);
+void
+_aks_file_release(AksFile        *self,
+                  FileNodeData   *data,
+                  GBytes         *bytes);
+GBytes*
+_aks_file_get_bytes(AksFile        *self,
+                    FileNodeData   *data,
+                    GCancellable   *cancellable,
+                    GError        **error);
+
+gchar*
+_aks_index_get_identity(FileArchive    *archive,
+                        GCancellable   *cancellable,
+                        GError        **error);
+gboolean
+_aks_index_load(FileArchive      *archive,
+                IndexEntryFunc    func,
+                gpointer          user_data);
+gboolean
+_aks_index_save(FileArchive    *archive,
+                GError        **error);
+
+FileCache*
+_aks_cache_new(guint64 budget);
+FileCache*
+_aks_cache_ref(FileCache* cache);
+void
+_aks_cache_unref(FileCache* cache);
+GBytes*
+_aks_cache_lookup(FileCache      *cache,
+                  FileNodeData   *data);
+GBytes*
+_aks_cache_insert(FileCache      *cache,
+                  FileNodeData   *data,
+                  GBytes         *bytes);
+void
+_aks_cache_pin(FileCache      *cache,
+               FileNodeData   *data);
+void
+_aks_cache_unpin(FileCache      *cache,
+                 FileNodeData   *data);
+gboolean
+_aks_cache_claim(FileCache      *cache,
+                 FileNodeData   *data);
+GBytes*
+_aks_cache_wait(FileCache      *cache,
+                FileNodeData   *data,
+                GCancellable   *cancellable,
+                GError        **error);
+void
+_aks_cache_release(FileCache      *cache,
+                   FileNodeData   *data,
+                   GBytes         *bytes);
+gchar*
+_aks_shared_cache_key(FileArchive    *archive,
+                      FileNodeData   *data);
+void
+_aks_shared_cache_set_budget(guint64 budget);
+GBytes*
+_aks_shared_cache_lookup(const gchar* key);
+GBytes*
+_aks_shared_cache_insert(const gchar   *key,
+                         GBytes        *bytes);
+void
+_aks_shared_cache_pin(const gchar* key);
+void
+_aks_shared_cache_unpin(const gchar* key);
+gboolean
+_aks_shared_cache_claim(const gchar* key);
+GBytes*
+_aks_shared_cache_wait(const gchar    *key,
+                       GCancellable   *cancellable,
+                       GError        **error);
+void
+_aks_shared_cache_release(const gchar   *key,
+                          GBytes        *bytes);
+
+GzipIndex*
+_aks_gzip_index_new(guint64 interval);
+GzipIndex*
+_aks_gzip_index_ref(GzipIndex* index);
+void
+_aks_gzip_index_unref(GzipIndex* index);
+void
+_aks_gzip_index_seal(GzipIndex* index);
+GVariant*
+_aks_gzip_index_serialize(GzipIndex* index);
+GzipIndex*
+_aks_gzip_index_deserialize(GVariant* variant,
+                            guint64   interval);
+gboolean
+_aks_gzip_probe(FileArchive    *archive,
+                GCancellable   *cancellable);
+GzipReader*
+_aks_gzip_reader_new(FileArchive    *archive,
+                     goffset         offset,
+                     GCancellable   *cancellable,
+                     GError        **error);
+gssize
+_aks_gzip_reader_read(GzipReader     *self,
+                      const void    **pblock,
+                      GCancellable   *cancellable,
+                      GError        **error);
+void
+_aks_gzip_reader_free(GzipReader* self);
 
 #if __cplusplus
 }
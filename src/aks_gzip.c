@@ -0,0 +1,720 @@
+/*  Copyright 2021-2022 MarcosHCK
+ *  This file is part of libakashic.
+ *
+ *  libakashic is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libakashic is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libakashic. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <aks_file_private.h>
+#if HAVE_ZLIB
+# include <zlib.h>
+#endif // HAVE_ZLIB
+
+/*
+ * Gzip checkpoints
+ * Deflate streams can be resumed at
+ * any block boundary given the bits
+ * left over from previous byte and
+ * last 32 KiB of output, so those are
+ * recorded every so often while
+ * exploring, and reads start from
+ * nearest one instead of archive
+ * start (as zlib's zran example)
+ *
+ */
+
+#if HAVE_ZLIB
+
+#define GZIP_WINDOW     32768
+#define GZIP_RING       (GZIP_WINDOW << 2)
+#define GZIP_CHUNK      65536
+#define GZIP_TRAILER    8
+
+typedef struct _GzipCheckpoint GzipCheckpoint;
+
+struct _GzipCheckpoint
+{
+  goffset in;
+  goffset out;
+  gint bits;
+  gsize window_size;
+  guint8 window[];
+};
+
+struct _GzipIndex
+{
+  grefcount refs;
+  guint64 interval;
+  gboolean complete;
+  GPtrArray* points;
+};
+
+struct _GzipReader
+{
+  GzipIndex* index;
+  gboolean record;
+  goffset last;
+
+/*
+ * Compressed input (mapping
+ * or archive stream, read at
+ * our own position, which is
+ * relative to archive start)
+ *
+ */
+  FileArchive* archive;
+  GBytes* mapped;
+  goffset in_end;
+  guint8* input;
+
+/*
+ * Inflater and output ring,
+ * which always holds last
+ * GZIP_RING bytes of output
+ *
+ */
+  z_stream strm;
+  gboolean ready;
+  gboolean raw;
+  gboolean boundary;
+  gboolean done;
+  goffset out;
+  guint8* ring;
+  gsize ring_pos;
+
+/*
+ * Output produced while
+ * discarding up to first
+ * wanted byte
+ *
+ */
+  const guint8* pending;
+  gsize pending_size;
+};
+
+GzipIndex*
+_aks_gzip_index_new(guint64 interval)
+{
+  GzipIndex* index =
+  g_slice_new0(GzipIndex);
+  g_ref_count_init(&(index->refs));
+
+  index->interval = interval;
+  index->points = g_ptr_array_new_with_free_func(g_free);
+return index;
+}
+
+GzipIndex*
+_aks_gzip_index_ref(GzipIndex* index)
+{
+  g_ref_count_inc(&(index->refs));
+return index;
+}
+
+void
+_aks_gzip_index_unref(GzipIndex* index)
+{
+  if(g_ref_count_dec(&(index->refs)))
+  {
+    g_ptr_array_unref(index->points);
+    g_slice_free(GzipIndex, index);
+  }
+}
+
+void
+_aks_gzip_index_seal(GzipIndex* index)
+{
+  index->complete = TRUE;
+}
+
+GVariant*
+_aks_gzip_index_serialize(GzipIndex* index)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE(GZIP_INDEX_TYPE));
+  for(i = 0;i < index->points->len;i++)
+  {
+    GzipCheckpoint* point =
+    g_ptr_array_index(index->points, i);
+
+    g_variant_builder_add
+    (&builder,
+     "(xxy@ay)",
+     (gint64) point->in,
+     (gint64) point->out,
+     (guint8) point->bits,
+     g_variant_new_fixed_array
+     (G_VARIANT_TYPE_BYTE,
+      point->window,
+      point->window_size,
+      sizeof(guint8)));
+  }
+return g_variant_builder_end(&builder);
+}
+
+GzipIndex*
+_aks_gzip_index_deserialize(GVariant* variant,
+                            guint64   interval)
+{
+  GzipIndex* index =
+  _aks_gzip_index_new(interval);
+  GVariantIter iter;
+  GVariant* window;
+  gint64 in, out;
+  guint8 bits;
+
+  g_variant_iter_init(&iter, variant);
+  while(g_variant_iter_next(&iter, "(xxy@ay)", &in, &out, &bits, &window))
+  {
+    gsize window_size = 0;
+    const guint8* data =
+    g_variant_get_fixed_array
+    (window,
+     &window_size,
+     sizeof(guint8));
+
+    window_size = MIN(window_size, GZIP_WINDOW);
+
+    GzipCheckpoint* point =
+    g_malloc(sizeof(GzipCheckpoint) + window_size);
+    point->in = in;
+    point->out = out;
+    point->bits = bits & 7;
+    point->window_size = window_size;
+    memcpy(point->window, data, window_size);
+
+    g_ptr_array_add(index->points, point);
+    g_variant_unref(window);
+  }
+
+  index->complete = TRUE;
+return index;
+}
+
+gboolean
+_aks_gzip_probe(FileArchive    *archive,
+                GCancellable   *cancellable)
+{
+  guint8 magic[3];
+
+  gboolean success =
+  _aks_archive_read_at
+  (archive,
+   0,
+   magic,
+   sizeof(magic),
+   cancellable,
+   NULL);
+return success
+    && magic[0] == 0x1f
+    && magic[1] == 0x8b
+    && magic[2] == Z_DEFLATED;
+}
+
+/*
+ * Input part
+ *
+ */
+
+static gboolean
+refill(GzipReader     *self,
+       GCancellable   *cancellable,
+       GError        **error)
+{
+  GError* tmp_err = NULL;
+
+  if(self->mapped != NULL)
+  {
+    gsize size = 0;
+    const guint8* base =
+    g_bytes_get_data(self->mapped, &size);
+    gsize available = size - (gsize) self->in_end;
+
+    self->strm.next_in = (Bytef*) (base + self->in_end);
+    self->strm.avail_in = (uInt) MIN(available, G_MAXUINT32);
+    self->in_end += self->strm.avail_in;
+  }
+  else
+  {
+    gsize read = 0;
+    _aks_archive_pread
+    (self->archive,
+     self->in_end,
+     self->input,
+     GZIP_CHUNK,
+     &read,
+     cancellable,
+     &tmp_err);
+
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      return FALSE;
+    }
+
+    self->strm.next_in = self->input;
+    self->strm.avail_in = (uInt) read;
+    self->in_end += read;
+  }
+return TRUE;
+}
+
+static void
+position(GzipReader     *self,
+         goffset         offset)
+{
+  self->strm.avail_in = 0;
+  self->in_end = offset;
+}
+
+static gboolean
+skip_input(GzipReader     *self,
+           gsize           count,
+           GCancellable   *cancellable,
+           GError        **error)
+{
+  while(count > 0)
+  {
+    if(self->strm.avail_in == 0)
+    {
+      if G_UNLIKELY(refill(self, cancellable, error) == FALSE)
+        return FALSE;
+      if G_UNLIKELY(self->strm.avail_in == 0)
+        break;
+    }
+
+    gsize take = MIN(count, self->strm.avail_in);
+    self->strm.next_in += take;
+    self->strm.avail_in -= (uInt) take;
+    count -= take;
+  }
+return TRUE;
+}
+
+/*
+ * Output part
+ *
+ */
+
+static void
+record(GzipReader* self)
+{
+  GzipIndex* index = self->index;
+  gsize window_size = (gsize)
+  MIN(self->out, GZIP_WINDOW);
+
+  GzipCheckpoint* point =
+  g_malloc(sizeof(GzipCheckpoint) + window_size);
+  point->in = self->in_end - self->strm.avail_in;
+  point->out = self->out;
+  point->bits = self->strm.data_type & 7;
+  point->window_size = window_size;
+
+/*
+ * Window is whatever precedes
+ * current ring position, which
+ * may wrap around
+ *
+ */
+  gsize tail = MIN(window_size, self->ring_pos);
+  gsize head = window_size - tail;
+
+  if(head > 0)
+    memcpy(point->window, self->ring + GZIP_RING - head, head);
+  memcpy(point->window + head, self->ring + self->ring_pos - tail, tail);
+
+  g_ptr_array_add(index->points, point);
+  self->last = self->out;
+}
+
+static gboolean
+set_zlib_error(GzipReader  *self,
+               int          code,
+               GError     **error)
+{
+  g_set_error
+  (error,
+   AKS_FILE_ERROR,
+   AKS_FILE_ERROR_FAILED,
+   "zlib: %i: %s\r\n",
+   code,
+   (self->strm.msg != NULL)
+   ? self->strm.msg
+   : "unknown error");
+return FALSE;
+}
+
+static gssize
+inflate_block(GzipReader     *self,
+              const void    **pblock,
+              GCancellable   *cancellable,
+              GError        **error)
+{
+  if(self->ring_pos == GZIP_RING)
+    self->ring_pos = 0;
+
+  guint8* block = self->ring + self->ring_pos;
+  gsize room = GZIP_RING - self->ring_pos;
+
+  self->strm.next_out = block;
+  self->strm.avail_out = (uInt) room;
+
+  while(self->strm.avail_out == room
+        && self->done == FALSE)
+  {
+    if(self->strm.avail_in == 0)
+    {
+      if G_UNLIKELY(refill(self, cancellable, error) == FALSE)
+        return -1;
+
+      if(self->strm.avail_in == 0)
+      {
+      /*
+       * Input ending right after
+       * a member is fine, anywhere
+       * else it is truncated
+       *
+       */
+        if G_UNLIKELY(self->boundary == FALSE)
+        {
+          g_set_error
+          (error,
+           AKS_FILE_ERROR,
+           AKS_FILE_ERROR_FAILED,
+           "truncated gzip stream\r\n");
+          return -1;
+        }
+
+        self->done = TRUE;
+        break;
+      }
+    }
+
+    uInt before = self->strm.avail_out;
+    int return_ = inflate(&(self->strm), Z_BLOCK);
+    self->out += before - self->strm.avail_out;
+    self->ring_pos += before - self->strm.avail_out;
+
+    if(return_ == Z_OK || return_ == Z_BUF_ERROR)
+    {
+      self->boundary = FALSE;
+
+      if(self->record == TRUE
+         && (self->strm.data_type & 128) != 0
+         && (self->strm.data_type & 64) == 0
+         && (self->index->points->len == 0
+             || (guint64) (self->out - self->last) >= self->index->interval))
+        record(self);
+    } else
+    if(return_ == Z_STREAM_END)
+    {
+    /*
+     * Another member may follow,
+     * a raw inflater (resumed from
+     * a checkpoint) leaves trailer
+     * to us
+     *
+     */
+      if(self->raw == TRUE)
+      {
+        if G_UNLIKELY(skip_input(self, GZIP_TRAILER, cancellable, error) == FALSE)
+          return -1;
+        inflateReset2(&(self->strm), 31);
+        self->raw = FALSE;
+      }
+      else
+      {
+        inflateReset(&(self->strm));
+      }
+
+      self->boundary = TRUE;
+    } else
+    if(return_ == Z_DATA_ERROR
+       && self->boundary == TRUE)
+    {
+    /*
+     * Trailing garbage after
+     * last member is ignored,
+     * as gzip(1) does
+     *
+     */
+      self->done = TRUE;
+    }
+    else
+    {
+      set_zlib_error(self, return_, error);
+      return -1;
+    }
+  }
+
+  pblock[0] = block;
+return (gssize) (room - self->strm.avail_out);
+}
+
+/*
+ * Reader
+ *
+ */
+
+static gint
+compare_point(gconstpointer   pkey,
+              gconstpointer   ppoint)
+{
+  goffset key = *(const goffset*) pkey;
+  const GzipCheckpoint* point = *(GzipCheckpoint* const*) ppoint;
+return (key < point->out) ? -1 : (key > point->out) ? 1 : 0;
+}
+
+static GzipCheckpoint*
+nearest_point(GzipIndex  *index,
+              goffset     offset)
+{
+  GPtrArray* points = index->points;
+  guint lo = 0, hi = points->len;
+
+  while(lo < hi)
+  {
+    guint mid = lo + ((hi - lo) >> 1);
+    GzipCheckpoint* point =
+    g_ptr_array_index(points, mid);
+
+    if(compare_point(&offset, &point) < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+return (lo > 0) ? g_ptr_array_index(points, lo - 1) : NULL;
+}
+
+GzipReader*
+_aks_gzip_reader_new(FileArchive    *archive,
+                     goffset         offset,
+                     GCancellable   *cancellable,
+                     GError        **error)
+{
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  GzipCheckpoint* point = NULL;
+
+  GzipReader* self =
+  g_slice_new0(GzipReader);
+
+  self->index = _aks_gzip_index_ref(archive->gzip);
+  self->archive = archive;
+  self->mapped = (archive->mapped) ? g_bytes_ref(archive->mapped) : NULL;
+  self->input = (archive->mapped) ? NULL : g_malloc(GZIP_CHUNK);
+  self->ring = g_malloc(GZIP_RING);
+
+/*
+ * Reading from start while
+ * index is incomplete means
+ * we are exploring
+ *
+ */
+  if(offset < 0)
+  {
+    self->record = !self->index->complete;
+    offset = 0;
+  }
+  else
+  {
+    point =
+    nearest_point(self->index, offset);
+  }
+
+  if(point == NULL)
+  {
+    if G_UNLIKELY(inflateInit2(&(self->strm), 31) != Z_OK)
+    {
+      set_zlib_error(self, Z_MEM_ERROR, error);
+      goto_error();
+    }
+
+    self->ready = TRUE;
+
+    position(self, 0);
+  }
+  else
+  {
+    if G_UNLIKELY(inflateInit2(&(self->strm), -15) != Z_OK)
+    {
+      set_zlib_error(self, Z_MEM_ERROR, error);
+      goto_error();
+    }
+
+    self->ready = TRUE;
+    self->raw = TRUE;
+    self->out = point->out;
+
+    position(self, point->in - (point->bits ? 1 : 0));
+
+    if(point->bits != 0)
+    {
+      if G_UNLIKELY(refill(self, cancellable, error) == FALSE)
+        goto_error();
+
+      if G_UNLIKELY(self->strm.avail_in == 0)
+      {
+        g_set_error
+        (error,
+         AKS_FILE_ERROR,
+         AKS_FILE_ERROR_FAILED,
+         "truncated gzip stream\r\n");
+        goto_error();
+      }
+
+      int byte = self->strm.next_in[0];
+      self->strm.next_in++;
+      self->strm.avail_in--;
+      inflatePrime(&(self->strm), point->bits, byte >> (8 - point->bits));
+    }
+
+    if(point->window_size > 0)
+    inflateSetDictionary
+    (&(self->strm),
+     point->window,
+     (uInt) point->window_size);
+  }
+
+/*
+ * Discard output up
+ * to wanted offset
+ *
+ */
+  while(self->out < offset)
+  {
+    const void* block = NULL;
+    goffset before = self->out;
+
+    gssize read =
+    inflate_block(self, &block, cancellable, &tmp_err);
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      goto_error();
+    }
+
+    if G_UNLIKELY(read == 0)
+      break;
+
+    if(self->out > offset)
+    {
+      gsize skip = (gsize) (offset - before);
+      self->pending = (const guint8*) block + skip;
+      self->pending_size = (gsize) read - skip;
+    }
+  }
+
+_error_:
+  if G_UNLIKELY(success == FALSE)
+    g_clear_pointer(&self, _aks_gzip_reader_free);
+return self;
+}
+
+gssize
+_aks_gzip_reader_read(GzipReader     *self,
+                      const void    **pblock,
+                      GCancellable   *cancellable,
+                      GError        **error)
+{
+  if(self->pending_size > 0)
+  {
+    gsize size = self->pending_size;
+    pblock[0] = self->pending;
+    self->pending_size = 0;
+    return (gssize) size;
+  }
+return inflate_block(self, pblock, cancellable, error);
+}
+
+void
+_aks_gzip_reader_free(GzipReader* self)
+{
+  if(self->ready == TRUE)
+    inflateEnd(&(self->strm));
+
+  _aks_gzip_index_unref(self->index);
+  g_clear_pointer(&(self->mapped), g_bytes_unref);
+  g_free(self->input);
+  g_free(self->ring);
+  g_slice_free(GzipReader, self);
+}
+
+#else // !HAVE_ZLIB
+
+/*
+ * Without zlib no index is
+ * ever made, so nothing below
+ * gets called
+ *
+ */
+
+GzipIndex*
+_aks_gzip_index_new(guint64 interval) {
+return NULL;
+}
+
+GzipIndex*
+_aks_gzip_index_ref(GzipIndex* index) {
+return index;
+}
+
+void
+_aks_gzip_index_unref(GzipIndex* index) {
+}
+
+void
+_aks_gzip_index_seal(GzipIndex* index) {
+}
+
+GVariant*
+_aks_gzip_index_serialize(GzipIndex* index) {
+return NULL;
+}
+
+GzipIndex*
+_aks_gzip_index_deserialize(GVariant* variant,
+                            guint64   interval) {
+return NULL;
+}
+
+gboolean
+_aks_gzip_probe(FileArchive    *archive,
+                GCancellable   *cancellable) {
+return FALSE;
+}
+
+GzipReader*
+_aks_gzip_reader_new(FileArchive    *archive,
+                     goffset         offset,
+                     GCancellable   *cancellable,
+                     GError        **error) {
+return NULL;
+}
+
+gssize
+_aks_gzip_reader_read(GzipReader     *self,
+                      const void    **pblock,
+                      GCancellable   *cancellable,
+                      GError        **error) {
+return -1;
+}
+
+void
+_aks_gzip_reader_free(GzipReader* self) {
+}
+
+#endif // HAVE_ZLIB
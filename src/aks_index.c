@@ -0,0 +1,417 @@
+/*  Copyright 2021-2022 MarcosHCK
+ *  This file is part of libakashic.
+ *
+ *  libakashic is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libakashic is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libakashic. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <aks_file_private.h>
+#include <errno.h>
+
+/*
+ * On-disk index
+ * A serialized GVariant holding every
+ * entry found on initialization, named
+ * after archive identity, so a changed
+ * archive never finds an old index
+ *
+ */
+
+#define INDEX_MAGIC     "libakashic-index"
+#define INDEX_VERSION   4
+#define INDEX_SUFFIX    ".index"
+#define INDEX_SAMPLE    65536
+
+/*
+ * (magic, version, identity, checkpoint interval,
+ *  format, indexed, payload checksum, (entries,
+ *  gzip checkpoints)), where each entry is
+ * (pathname, UTF-8 pathname, mode, size, size set,
+ *  atime, atime_nsec, birthtime, birthtime_nsec, ctime,
+ *  ctime_nsec, mtime, mtime_nsec, symlink, offset)
+ *
+ */
+#define INDEX_ENTRY_TYPE  "(ayayuxbxxxxxxxxayx)"
+#define INDEX_ENTRY_NEW   "(^ay^ayuxbxxxxxxxx^ayx)"
+#define INDEX_ENTRY_GET   "(^&ay^&ayuxbxxxxxxxx^&ayx)"
+#define INDEX_PAYLOAD     "(a" INDEX_ENTRY_TYPE "m" GZIP_INDEX_TYPE ")"
+#define INDEX_TYPE        "(sustibs" INDEX_PAYLOAD ")"
+
+static gchar*
+get_index_path(FileArchive* archive) {
+  gchar* basename =
+  g_strconcat(archive->identity, INDEX_SUFFIX, NULL);
+  gchar* path =
+  g_build_filename(archive->index_directory, basename, NULL);
+  g_free(basename);
+return path;
+}
+
+static guint64
+get_mtime(FileArchive    *archive,
+          GCancellable   *cancellable)
+{
+  guint64 mtime = 0;
+
+  if(G_IS_FILE_INPUT_STREAM(archive->base_stream))
+  {
+    GFileInfo* info =
+    g_file_input_stream_query_info
+    (G_FILE_INPUT_STREAM(archive->base_stream),
+     G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+     G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+     cancellable,
+     NULL);
+
+    if G_LIKELY(info != NULL)
+    {
+      mtime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+            + g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+      g_object_unref(info);
+    }
+  }
+return mtime;
+}
+
+gchar*
+_aks_index_get_identity(FileArchive    *archive,
+                        GCancellable   *cancellable,
+                        GError        **error)
+{
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  GChecksum* checksum = NULL;
+  guint8* sample = NULL;
+  gchar* identity = NULL;
+
+  goffset size =
+  _aks_archive_get_size(archive, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    goto_error();
+  }
+
+/*
+ * Size, modification time (when
+ * stream comes from a file) and
+ * both ends of archive, which
+ * is where most formats keep
+ * their bookkeeping
+ *
+ */
+  guint64 size_ = (guint64) size;
+  guint64 mtime = get_mtime(archive, cancellable);
+  gsize sample_size = (gsize) MIN(size, INDEX_SAMPLE);
+
+  checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  g_checksum_update(checksum, (const guchar*) &size_, sizeof(size_));
+  g_checksum_update(checksum, (const guchar*) &mtime, sizeof(mtime));
+  sample = g_malloc(sample_size);
+
+  _aks_archive_read_at(archive, 0, sample, sample_size, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    goto_error();
+  }
+
+  g_checksum_update(checksum, sample, sample_size);
+
+  _aks_archive_read_at(archive, size - (goffset) sample_size, sample, sample_size, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    goto_error();
+  }
+
+  g_checksum_update(checksum, sample, sample_size);
+  identity = g_strdup(g_checksum_get_string(checksum));
+
+_error_:
+  g_free(sample);
+  if(checksum != NULL)
+    g_checksum_free(checksum);
+  if G_UNLIKELY(success == FALSE)
+    g_clear_pointer(&identity, g_free);
+return identity;
+}
+
+gboolean
+_aks_index_load(FileArchive      *archive,
+                IndexEntryFunc    func,
+                gpointer          user_data)
+{
+  gboolean success = TRUE;
+  GMappedFile* mapped = NULL;
+  GBytes* bytes = NULL;
+  GVariant* index = NULL;
+  GVariant* payload = NULL;
+  GVariant* entries = NULL;
+  GVariant* gzip = NULL;
+  gchar* actual = NULL;
+  gchar* path = NULL;
+
+  path = get_index_path(archive);
+  mapped = g_mapped_file_new(path, FALSE, NULL);
+  if(mapped == NULL)
+    goto_error();
+
+  bytes = g_mapped_file_get_bytes(mapped);
+  index =
+  g_variant_new_from_bytes
+  (G_VARIANT_TYPE(INDEX_TYPE),
+   bytes,
+   FALSE);
+  g_variant_ref_sink(index);
+
+/*
+ * Anything which is not exactly
+ * what we wrote (truncated writes,
+ * older versions, another endianness)
+ * is stale, and gets rebuilt
+ *
+ */
+  if G_UNLIKELY(g_variant_is_normal_form(index) == FALSE)
+    goto_error();
+
+  const gchar *magic, *identity, *checksum;
+  guint32 version;
+  guint64 interval;
+  gint32 format;
+  gboolean indexed;
+
+  g_variant_get_child(index, 0, "&s", &magic);
+  g_variant_get_child(index, 1, "u", &version);
+  g_variant_get_child(index, 2, "&s", &identity);
+  g_variant_get_child(index, 3, "t", &interval);
+  g_variant_get_child(index, 4, "i", &format);
+  g_variant_get_child(index, 5, "b", &indexed);
+  g_variant_get_child(index, 6, "&s", &checksum);
+  payload = g_variant_get_child_value(index, 7);
+
+  actual =
+  g_compute_checksum_for_data
+  (G_CHECKSUM_SHA256,
+   g_variant_get_data(payload),
+   g_variant_get_size(payload));
+
+/*
+ * An index made with another
+ * checkpoint interval has offsets
+ * which may be useless (or useful
+ * only with checkpoints we lack)
+ *
+ */
+  if G_UNLIKELY
+    (g_strcmp0(magic, INDEX_MAGIC) != 0
+     || version != INDEX_VERSION
+     || g_strcmp0(identity, archive->identity) != 0
+     || interval != archive->checkpoint_interval
+     || g_strcmp0(checksum, actual) != 0)
+    goto_error();
+
+  g_variant_get_child(payload, 0, "@a" INDEX_ENTRY_TYPE, &entries);
+  g_variant_get_child(payload, 1, "m@" GZIP_INDEX_TYPE, &gzip);
+
+/*
+ * Index is good, hand
+ * entries back
+ *
+ */
+  GVariantIter iter;
+  FileEntry entry;
+  gint64 atime_nsec, birthtime_nsec;
+  gint64 ctime_nsec, mtime_nsec;
+
+  g_variant_iter_init(&iter, entries);
+  while(g_variant_iter_next
+        (&iter,
+         INDEX_ENTRY_GET,
+         &(entry.pathname), &(entry.pathname_utf8),
+         &(entry.mode), &(entry.size), &(entry.size_set),
+         &(entry.atime), &atime_nsec,
+         &(entry.birthtime), &birthtime_nsec,
+         &(entry.ctime), &ctime_nsec,
+         &(entry.mtime), &mtime_nsec,
+         &(entry.symlink), &(entry.offset)))
+  {
+    entry.atime_nsec = (gint32) atime_nsec;
+    entry.birthtime_nsec = (gint32) birthtime_nsec;
+    entry.ctime_nsec = (gint32) ctime_nsec;
+    entry.mtime_nsec = (gint32) mtime_nsec;
+    if(entry.symlink[0] == '\0')
+      entry.symlink = NULL;
+    if(entry.pathname_utf8[0] == '\0')
+      entry.pathname_utf8 = NULL;
+
+    func(&entry, user_data);
+  }
+
+  if(gzip != NULL)
+  {
+    archive->gzip =
+    _aks_gzip_index_deserialize
+    (gzip,
+     interval);
+  }
+
+  archive->format = format;
+  archive->indexed = indexed;
+
+_error_:
+  g_free(path);
+  g_free(actual);
+  if(gzip != NULL)
+    g_variant_unref(gzip);
+  if(entries != NULL)
+    g_variant_unref(entries);
+  if(payload != NULL)
+    g_variant_unref(payload);
+  if(index != NULL)
+    g_variant_unref(index);
+  if(bytes != NULL)
+    g_bytes_unref(bytes);
+  if(mapped != NULL)
+    g_mapped_file_unref(mapped);
+return success;
+}
+
+static void
+save_entry(FileEntry         *entry,
+           GVariantBuilder   *builder)
+{
+  if G_UNLIKELY(entry->pathname == NULL)
+    return;
+
+  g_variant_builder_add
+  (builder,
+   INDEX_ENTRY_NEW,
+   entry->pathname,
+   (entry->pathname_utf8 != NULL) ? entry->pathname_utf8 : "",
+   entry->mode,
+   entry->size,
+   entry->size_set,
+   entry->atime,
+   (gint64) entry->atime_nsec,
+   entry->birthtime,
+   (gint64) entry->birthtime_nsec,
+   entry->ctime,
+   (gint64) entry->ctime_nsec,
+   entry->mtime,
+   (gint64) entry->mtime_nsec,
+   (entry->symlink != NULL) ? entry->symlink : "",
+   entry->offset);
+}
+
+gboolean
+_aks_index_save(FileArchive    *archive,
+                GError        **error)
+{
+  gboolean success = TRUE;
+  GVariantBuilder builder;
+  GVariant* payload = NULL;
+  GVariant* index = NULL;
+  gchar* checksum = NULL;
+  gchar* path = NULL;
+
+  if G_UNLIKELY
+    (g_mkdir_with_parents
+     (archive->index_directory,
+      0700) < 0)
+  {
+    int e = errno;
+    g_set_error
+    (error,
+     G_IO_ERROR,
+     g_io_error_from_errno(e),
+     "%s: %s\r\n",
+     archive->index_directory,
+     g_strerror(e));
+    goto_error();
+  }
+
+/*
+ * Root entry is made up,
+ * everything else on table
+ * came from archive
+ *
+ */
+  guint i, length =
+  _aks_entry_table_get_length(archive->entries);
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a" INDEX_ENTRY_TYPE));
+  for(i = 0; i < length; i++)
+  {
+    if((gint) i != archive->root->data->entry)
+      save_entry
+      (_aks_entry_table_get
+       (archive->entries,
+        (gint) i),
+       &builder);
+  }
+
+  payload =
+  g_variant_new
+  ("(@a" INDEX_ENTRY_TYPE "@m" GZIP_INDEX_TYPE ")",
+   g_variant_builder_end(&builder),
+   g_variant_new_maybe
+   (G_VARIANT_TYPE(GZIP_INDEX_TYPE),
+    (archive->gzip != NULL)
+    ? _aks_gzip_index_serialize(archive->gzip)
+    : NULL));
+  g_variant_ref_sink(payload);
+
+  checksum =
+  g_compute_checksum_for_data
+  (G_CHECKSUM_SHA256,
+   g_variant_get_data(payload),
+   g_variant_get_size(payload));
+
+  index =
+  g_variant_new
+  ("(sustibs@" INDEX_PAYLOAD ")",
+   INDEX_MAGIC,
+   (guint32) INDEX_VERSION,
+   archive->identity,
+   (guint64) archive->checkpoint_interval,
+   (gint32) archive->format,
+   archive->indexed,
+   checksum,
+   payload);
+  g_variant_ref_sink(index);
+
+/*
+ * Written into a temporary
+ * file and renamed, so readers
+ * never see half an index
+ *
+ */
+  path = get_index_path(archive);
+  success =
+  g_file_set_contents
+  (path,
+   g_variant_get_data(index),
+   g_variant_get_size(index),
+   error);
+
+_error_:
+  g_free(path);
+  g_free(checksum);
+  if(index != NULL)
+    g_variant_unref(index);
+  if(payload != NULL)
+    g_variant_unref(payload);
+return success;
+}
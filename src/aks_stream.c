@@ -18,6 +18,7 @@
 #include <config.h>
 #include <aks_file_private.h>
 #include <aks_stream.h>
+#include <string.h>
 
 /*
  * Object definition
@@ -30,21 +31,52 @@ struct _AksStream
 
   /*<private>*/
   struct archive* ar;
+
+  /*
+   * Where entry came from, so
+   * it can be opened again when
+   * seeking backwards
+   *
+   */
+  FileArchive* archive;
+  FileNodeData* data;
+
+  /*
+   * Data block last handed by
+   * libarchive, its offset on
+   * entry and our own (which
+   * falls before block on
+   * sparse entries holes)
+   *
+   */
+  const guint8* block;
+  gsize block_size;
+  gint64 block_offset;
+  gint64 position;
+  gboolean eof;
 };
 
 enum {
   prop_0,
   prop_archive,
+  prop_file_archive,
+  prop_node_data,
   prop_number,
 };
 
 static
 GParamSpec* properties[prop_number] = {0};
 
-G_DEFINE_TYPE
+static
+void aks_stream_g_seekable_iface_init(GSeekableIface* iface);
+
+G_DEFINE_TYPE_WITH_CODE
 (AksStream,
  aks_stream,
- G_TYPE_INPUT_STREAM);
+ G_TYPE_INPUT_STREAM,
+ G_IMPLEMENT_INTERFACE
+ (G_TYPE_SEEKABLE,
+  aks_stream_g_seekable_iface_init));
 
 typedef struct {
   void* buffer;
@@ -56,42 +88,238 @@ read_data_free(ReadData* data) {
   g_slice_free(ReadData, data);
 }
 
-#undef goto_error
-#define goto_error() \
-G_STMT_START { \
-  result = -1; \
-  goto _error_; \
-} G_STMT_END
+/*
+ * Reads go through libarchive
+ * data blocks, which are either
+ * copied out (plain reads), handed
+ * as they are (splice) or as slices
+ * of mapped input (read_bytes)
+ *
+ */
 
-static void
-read_fn(GTask* task,
-        AksStream* self,
-        ReadData* data,
-        GCancellable* cancellable)
+/*
+ * Entry size as far as entries
+ * table knows (-1 for entries
+ * we know nothing about, or
+ * whose archive doesn't tell
+ * their size beforehand)
+ *
+ */
+static gint64
+entry_size(AksStream* self)
+{
+  if(self->data == NULL)
+    return -1;
+
+  FileEntry* entry =
+  _aks_entry_table_get
+  (self->archive->entries,
+   self->data->entry);
+return (entry->size_set == TRUE) ? entry->size : -1;
+}
+
+static gboolean
+next_block(AksStream      *self,
+           GError        **error)
+{
+  const void* block;
+  la_int64_t offset;
+  size_t size;
+
+  while(self->eof == FALSE
+        && self->position >= self->block_offset + (gint64) self->block_size)
+  {
+    int code =
+    archive_read_data_block(self->ar, &block, &size, &offset);
+    if G_UNLIKELY(code < 0)
+    {
+      g_propagate_error
+      (error,
+       _aks_archive_get_gerror
+       (G_OBJECT(self),
+        self->ar));
+      return FALSE;
+    }
+
+  /*
+   * Sparse entries may end on
+   * a hole, which is left as an
+   * empty block at entry end
+   *
+   */
+    if(code == ARCHIVE_EOF)
+    {
+      self->eof = TRUE;
+      self->block = NULL;
+      self->block_size = 0;
+      self->block_offset = MAX(offset, entry_size(self));
+      break;
+    }
+
+    self->block = block;
+    self->block_size = size;
+    self->block_offset = offset;
+  }
+return TRUE;
+}
+
+/*
+ * Points at what comes next, up
+ * to count bytes (NULL on a hole,
+ * zero length at entry end)
+ *
+ */
+static gsize
+peek_block(AksStream      *self,
+           gsize           count,
+           const guint8  **pblock)
 {
+  if(self->position < self->block_offset)
+  {
+    pblock[0] = NULL;
+    return (gsize) MIN((gint64) count, self->block_offset - self->position);
+  }
+
+  if(self->eof == TRUE)
+  {
+    pblock[0] = NULL;
+    return 0;
+  }
+
+  gsize skip = (gsize) (self->position - self->block_offset);
+  pblock[0] = self->block + skip;
+return MIN(count, self->block_size - skip);
+}
+
+/*
+ * Synchronous calls run right
+ * on caller thread, only async
+ * ones go through thread pool
+ *
+ */
+
+static gssize
+read_sync(AksStream      *self,
+          void           *buffer,
+          gsize           count,
+          GCancellable   *cancellable,
+          GError        **error)
+{
+  const guint8* block = NULL;
+  gssize result = -1;
+
   _aks_archive_set_cancellable
   (G_OBJECT(self), self->ar, cancellable);
-  gssize result = -1;
 
-  la_ssize_t return_ =
-  archive_read_data(self->ar, data->buffer, data->count);
-  if G_UNLIKELY(return_ < 0)
+  if G_LIKELY(next_block(self, error) == TRUE)
   {
-    g_task_return_error
-    (task,
-     _aks_archive_get_gerror
-     (G_OBJECT(self),
-      self->ar));
-    goto_error();
-  } else
+    gsize read =
+    peek_block(self, count, &block);
+
+    if(block == NULL)
+      memset(buffer, 0, read);
+    else
+      memcpy(buffer, block, read);
+
+    self->position += (gint64) read;
+    result = (gssize) read;
+  }
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(self), self->ar, NULL);
+return result;
+}
+
+static gssize
+skip_sync(AksStream      *self,
+          gsize           count_,
+          GCancellable   *cancellable,
+          GError        **error)
+{
+  const guint8* block = NULL;
+  gssize result = 0;
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(self), self->ar, cancellable);
+
+/*
+ * Skipping what is left of entry
+ * is libarchive business, which on
+ * plain archives ends up as a single
+ * seek on input (anything shorter
+ * drops whole data blocks, which
+ * are never copied, and on mapped
+ * input cost nothing at all); only
+ * done when entry size is known,
+ * entry end is found walking
+ * blocks otherwise
+ *
+ */
+  if(self->data != NULL
+     && self->eof == FALSE)
   {
-    result = (gssize) return_;
+    gint64 size =
+    entry_size(self);
+
+    if(size >= self->position
+       && (guint64) (size - self->position) <= count_)
+    {
+      if G_UNLIKELY(archive_read_data_skip(self->ar) < 0)
+      {
+        g_propagate_error
+        (error,
+         _aks_archive_get_gerror
+         (G_OBJECT(self),
+          self->ar));
+        result = -1;
+      }
+      else
+      {
+        result = (gssize) (size - self->position);
+        self->position = size;
+        self->eof = TRUE;
+      }
+
+      count_ = 0;
+    }
+  }
+
+  while(count_ != 0)
+  {
+    if G_UNLIKELY(next_block(self, error) == FALSE)
+    {
+      result = -1;
+      break;
+    }
+
+    gsize skipped =
+    peek_block(self, count_, &block);
+    if G_UNLIKELY(skipped == 0)
+      break;
+
+    self->position += (gint64) skipped;
+    result += (gssize) skipped;
+    count_ -= skipped;
   }
 
-_error_:
   _aks_archive_set_cancellable
   (G_OBJECT(self), self->ar, NULL);
-  if G_LIKELY(result != -1)
+return result;
+}
+
+static void
+read_fn(GTask* task,
+        AksStream* self,
+        ReadData* data,
+        GCancellable* cancellable)
+{
+  GError* tmp_err = NULL;
+
+  gssize result =
+  read_sync(self, data->buffer, data->count, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+    g_task_return_error(task, tmp_err);
+  else
     g_task_return_int(task, result);
 }
 
@@ -102,24 +330,7 @@ aks_stream_class_read_fn(GInputStream* stream,
                          GCancellable* cancellable,
                          GError** error)
 {
-  GTask* task =
-  g_task_new
-  (stream,
-   cancellable,
-   NULL, NULL);
-
-  ReadData* data =
-  g_slice_new(ReadData);
-  data->buffer = buffer;
-  data->count = count;
-
-  g_task_set_name(task, "[libakashic] AksStream::read_fn");
-  g_task_set_priority(task, G_PRIORITY_DEFAULT);
-  g_task_set_task_data(task, data, (GDestroyNotify) read_data_free);
-  g_task_run_in_thread_sync(task, (GTaskThreadFunc) read_fn);
-  gssize return_ = g_task_propagate_int(task, error);
-  g_object_unref(task);
-return return_;
+return read_sync(AKS_STREAM(stream), buffer, count, cancellable, error);
 }
 
 static void
@@ -161,55 +372,19 @@ void skip_fn(GTask* task,
              gpointer count__,
              GCancellable* cancellable)
 {
-  _aks_archive_set_cancellable
-  (G_OBJECT(self), self->ar, cancellable);
-  gsize count_ = GPOINTER_TO_SIZE(count__);
-  gboolean success = 0;
-  gssize result = 0;
-
-  char skipb[128];
-
-  for(;count_ != 0;)
-  {
-    la_ssize_t return_ =
-    archive_read_data(self->ar, skipb, MIN(count_, sizeof(skipb)));
-    if G_UNLIKELY(return_ < 0)
-    {
-      g_task_return_error
-      (task,
-       _aks_archive_get_gerror
-       (G_OBJECT(self),
-        self->ar));
-      goto_error();
-    } else
-    {
-      result += (gssize) return_;
-      count_ -= (gsize) return_;
-    }
-  }
+  GError* tmp_err = NULL;
 
-_error_:
-  _aks_archive_set_cancellable
-  (G_OBJECT(self), self->ar, NULL);
-  if G_LIKELY(result != -1)
+  gssize result =
+  skip_sync(self, GPOINTER_TO_SIZE(count__), cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+    g_task_return_error(task, tmp_err);
+  else
     g_task_return_int(task, result);
 }
 
 static
 gssize aks_stream_class_skip(GInputStream* stream, gsize count_, GCancellable* cancellable, GError** error) {
-  GTask* task =
-  g_task_new
-  (stream,
-   cancellable,
-   NULL, NULL);
-
-  g_task_set_name(task, "[libakashic] AksStream::skip");
-  g_task_set_priority(task, G_PRIORITY_DEFAULT);
-  g_task_set_task_data(task, GSIZE_TO_POINTER(count_), NULL);
-  g_task_run_in_thread_sync(task, (GTaskThreadFunc) skip_fn);
-  gssize return_ = g_task_propagate_int(task, error);
-  g_object_unref(task);
-return return_;
+  return skip_sync(AKS_STREAM(stream), count_, cancellable, error);
 }
 
 static
@@ -233,6 +408,223 @@ gssize aks_stream_class_skip_finish(GInputStream* stream, GAsyncResult* res, GEr
   return g_task_propagate_int(G_TASK(res), error);
 }
 
+/*
+ * Seekable interface
+ * Forward seeks just skip, backward
+ * ones open entry again (which starts
+ * from its header offset or nearest
+ * decompression checkpoint when
+ * archive has them) and skip from
+ * its start
+ *
+ */
+
+static goffset
+aks_stream_g_seekable_iface_tell(GSeekable* pself) {
+return (goffset) AKS_STREAM(pself)->position;
+}
+
+static gboolean
+aks_stream_g_seekable_iface_can_seek(GSeekable* pself) {
+return AKS_STREAM(pself)->archive != NULL;
+}
+
+/*
+ * Readers of entries we
+ * know about go back to
+ * archive pool
+ *
+ */
+static void
+release(AksStream* self)
+{
+  if(self->archive == NULL)
+  {
+    _aks_archive_read_free
+    (G_OBJECT(self),
+     self->ar);
+  }
+  else
+  {
+    GObject* reader =
+    g_object_new(G_TYPE_OBJECT, NULL);
+
+    _aks_archive_switch_source_object
+    (G_OBJECT(self),
+     reader,
+     self->ar);
+
+    _aks_file_close_entry
+    (self->archive,
+     self->data,
+     reader,
+     self->ar);
+  }
+
+  self->ar = NULL;
+}
+
+static gboolean
+reopen(AksStream      *self,
+       GCancellable   *cancellable,
+       GError        **error)
+{
+  GError* tmp_err = NULL;
+  GObject* reader = NULL;
+
+  struct archive* ar =
+  _aks_file_open_entry
+  (self->archive,
+   self->data,
+   &reader,
+   cancellable,
+   &tmp_err);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return FALSE;
+  }
+
+/*
+ * Old reader goes away only
+ * once new one is ready, so
+ * a failed seek leaves
+ * stream as it was
+ *
+ */
+  release(self);
+  _aks_archive_switch_source_object
+  (reader,
+   G_OBJECT(self),
+   ar);
+  g_object_unref(reader);
+
+  self->ar = ar;
+  self->block = NULL;
+  self->block_size = 0;
+  self->block_offset = 0;
+  self->position = 0;
+  self->eof = FALSE;
+return TRUE;
+}
+
+static gboolean
+aks_stream_g_seekable_iface_seek(GSeekable       *pself,
+                                 goffset          offset,
+                                 GSeekType        type,
+                                 GCancellable    *cancellable,
+                                 GError         **error)
+{
+  AksStream* self = AKS_STREAM(pself);
+  GError* tmp_err = NULL;
+  gint64 target = 0;
+  gint64 size = 0;
+
+  if G_UNLIKELY(self->archive == NULL)
+  {
+    g_set_error
+    (error,
+     G_IO_ERROR,
+     G_IO_ERROR_NOT_SUPPORTED,
+     "Seek not supported on stream\r\n");
+    return FALSE;
+  }
+
+  if G_UNLIKELY(g_input_stream_set_pending(G_INPUT_STREAM(self), error) == FALSE)
+    return FALSE;
+
+  switch(type)
+  {
+  case G_SEEK_SET:
+    target = offset;
+    break;
+  case G_SEEK_CUR:
+    target = self->position + offset;
+    break;
+  case G_SEEK_END:
+  /*
+   * Entries of unknown size
+   * end wherever their last
+   * block does, so walk there
+   *
+   */
+    size = entry_size(self);
+    if(size < 0)
+    {
+      while(skip_sync(self, G_MAXSSIZE, cancellable, &tmp_err) > 0)
+        continue;
+      size = self->position;
+    }
+
+    target = size + offset;
+    break;
+  default:
+    g_critical("No standard seek target\r\n");
+    g_assert_not_reached();
+    break;
+  }
+
+  if G_UNLIKELY(tmp_err == NULL && target < 0)
+  {
+    g_set_error
+    (&tmp_err,
+     G_IO_ERROR,
+     G_IO_ERROR_INVALID_ARGUMENT,
+     "Invalid seek request\r\n");
+  }
+
+  if(tmp_err == NULL
+     && target < self->position)
+    reopen(self, cancellable, &tmp_err);
+
+/*
+ * Seeking past entry end
+ * just leaves us at end
+ *
+ */
+  if G_LIKELY(tmp_err == NULL
+              && target > self->position)
+    skip_sync(self, (gsize) (target - self->position), cancellable, &tmp_err);
+
+  g_input_stream_clear_pending(G_INPUT_STREAM(self));
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return FALSE;
+  }
+return TRUE;
+}
+
+static gboolean
+aks_stream_g_seekable_iface_can_truncate(GSeekable* pself) {
+return FALSE;
+}
+
+static gboolean
+aks_stream_g_seekable_iface_truncate_fn(GSeekable       *pself,
+                                        goffset          offset,
+                                        GCancellable    *cancellable,
+                                        GError         **error)
+{
+  g_set_error
+  (error,
+   G_IO_ERROR,
+   G_IO_ERROR_NOT_SUPPORTED,
+   "Truncate not supported on stream\r\n");
+return FALSE;
+}
+
+static
+void aks_stream_g_seekable_iface_init(GSeekableIface* iface) {
+  iface->tell = aks_stream_g_seekable_iface_tell;
+  iface->can_seek = aks_stream_g_seekable_iface_can_seek;
+  iface->seek = aks_stream_g_seekable_iface_seek;
+  iface->can_truncate = aks_stream_g_seekable_iface_can_truncate;
+  iface->truncate_fn = aks_stream_g_seekable_iface_truncate_fn;
+}
+
 static
 void aks_stream_class_set_property(GObject* pself, guint prop_id, const GValue* value, GParamSpec* pspec) {
   AksStream* self = AKS_STREAM(pself);
@@ -241,6 +633,14 @@ void aks_stream_class_set_property(GObject* pself, guint prop_id, const GValue*
   case prop_archive:
     self->ar = g_value_get_pointer(value);
     break;
+  case prop_file_archive:
+    if G_LIKELY(g_value_get_pointer(value) != NULL)
+      self->archive = _aks_file_archive_ref(g_value_get_pointer(value));
+    break;
+  case prop_node_data:
+    if G_LIKELY(g_value_get_pointer(value) != NULL)
+      self->data = _aks_node_data_ref(g_value_get_pointer(value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(pself, prop_id, pspec);
     break;
@@ -256,12 +656,10 @@ void aks_stream_class_dispose(GObject* pself) {
  *
  */
   if G_LIKELY(self->ar != NULL)
-  {
-    _aks_archive_read_free
-    (G_OBJECT(self),
-     self->ar);
-    self->ar = NULL;
-  }
+    release(self);
+
+  g_clear_pointer(&(self->data), _aks_node_data_unref);
+  g_clear_pointer(&(self->archive), _aks_file_archive_unref);
 
 /*
  * Chain-up
@@ -300,6 +698,22 @@ void aks_stream_class_init(AksStreamClass* klass) {
                          | G_PARAM_CONSTRUCT_ONLY
                          | G_PARAM_STATIC_STRINGS);
 
+  properties[prop_file_archive] =
+    g_param_spec_pointer("file-archive",
+                         "file-archive",
+                         "file-archive",
+                         G_PARAM_WRITABLE
+                         | G_PARAM_CONSTRUCT_ONLY
+                         | G_PARAM_STATIC_STRINGS);
+
+  properties[prop_node_data] =
+    g_param_spec_pointer("node-data",
+                         "node-data",
+                         "node-data",
+                         G_PARAM_WRITABLE
+                         | G_PARAM_CONSTRUCT_ONLY
+                         | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties(oclass,
                                     prop_number,
                                     properties);
@@ -308,3 +722,129 @@ void aks_stream_class_init(AksStreamClass* klass) {
 static
 void aks_stream_init(AksStream* self) {
 }
+
+/*
+ * Object methods
+ *
+ */
+
+GBytes*
+aks_stream_read_bytes(GInputStream   *stream,
+                      gsize           count,
+                      GCancellable   *cancellable,
+                      GError        **error)
+{
+  g_return_val_if_fail(G_IS_INPUT_STREAM(stream), NULL);
+  const guint8* block = NULL;
+  GBytes* bytes = NULL;
+
+  if(AKS_IS_STREAM(stream) == FALSE)
+    return g_input_stream_read_bytes(stream, count, cancellable, error);
+
+  AksStream* self = AKS_STREAM(stream);
+  if G_UNLIKELY(g_input_stream_set_pending(stream, error) == FALSE)
+    return NULL;
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(self), self->ar, cancellable);
+
+  if G_LIKELY(next_block(self, error) == TRUE)
+  {
+    gsize read =
+    peek_block(self, count, &block);
+
+    bytes = (block == NULL)
+    ? g_bytes_new_take(g_malloc0(read), read)
+    : _aks_archive_block_bytes(G_OBJECT(self), block, read);
+    self->position += (gint64) read;
+  }
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(self), self->ar, NULL);
+  g_input_stream_clear_pending(stream);
+return bytes;
+}
+
+gssize
+aks_stream_splice(GOutputStream            *target,
+                  GInputStream             *source,
+                  GOutputStreamSpliceFlags  flags,
+                  GCancellable             *cancellable,
+                  GError                  **error)
+{
+  g_return_val_if_fail(G_IS_OUTPUT_STREAM(target), -1);
+  g_return_val_if_fail(G_IS_INPUT_STREAM(source), -1);
+  static const guint8 zeroes[4096] = {0};
+  const guint8* block = NULL;
+  GError* tmp_err = NULL;
+  gssize result = 0;
+  gsize written = 0;
+
+  if(AKS_IS_STREAM(source) == FALSE)
+    return g_output_stream_splice(target, source, flags, cancellable, error);
+
+  AksStream* self = AKS_STREAM(source);
+  if G_UNLIKELY(g_input_stream_set_pending(source, error) == FALSE)
+    return -1;
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(self), self->ar, cancellable);
+
+/*
+ * Blocks are written right
+ * from where libarchive left
+ * them, holes from a
+ * zeroed buffer
+ *
+ */
+  for(;;)
+  {
+    if G_UNLIKELY(next_block(self, &tmp_err) == FALSE)
+      break;
+
+    gsize size =
+    peek_block(self, G_MAXSIZE, &block);
+    if(size == 0)
+      break;
+
+    if(block == NULL)
+      size = MIN(size, sizeof(zeroes));
+
+    g_output_stream_write_all
+    (target,
+     (block == NULL) ? zeroes : block,
+     size,
+     &written,
+     cancellable,
+     &tmp_err);
+
+    self->position += (gint64) written;
+    result += (gssize) written;
+
+    if G_UNLIKELY(tmp_err != NULL)
+      break;
+  }
+
+  _aks_archive_set_cancellable
+  (G_OBJECT(self), self->ar, NULL);
+  g_input_stream_clear_pending(source);
+
+  if(flags & G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE)
+  g_input_stream_close
+  (source,
+   cancellable,
+   (tmp_err == NULL) ? &tmp_err : NULL);
+
+  if(flags & G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET)
+  g_output_stream_close
+  (target,
+   cancellable,
+   (tmp_err == NULL) ? &tmp_err : NULL);
+
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    return -1;
+  }
+return result;
+}
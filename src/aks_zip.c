@@ -0,0 +1,344 @@
+/*  Copyright 2021-2022 MarcosHCK
+ *  This file is part of libakashic.
+ *
+ *  libakashic is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libakashic is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libakashic. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <config.h>
+#include <aks_file_private.h>
+
+/*
+ * Zip central directory reader
+ * Only what is needed to locate
+ * local file headers is parsed,
+ * libarchive does everything else
+ *
+ */
+
+#define ZIP_EOCD_SIGNATURE      0x06054b50
+#define ZIP_EOCD_SIZE           22
+#define ZIP_EOCD64_SIGNATURE    0x06064b50
+#define ZIP_EOCD64_SIZE         56
+#define ZIP_LOCATOR_SIGNATURE   0x07064b50
+#define ZIP_LOCATOR_SIZE        20
+#define ZIP_CDENTRY_SIGNATURE   0x02014b50
+#define ZIP_CDENTRY_SIZE        46
+#define ZIP_COMMENT_MAX         0xffff
+#define ZIP_EXTRA_ZIP64         0x0001
+
+static inline guint16
+get16(const guint8* p) {
+return (guint16) (p[0] | (p[1] << 8));
+}
+
+static inline guint32
+get32(const guint8* p) {
+return (guint32) get16(p) | ((guint32) get16(p + 2) << 16);
+}
+
+static inline guint64
+get64(const guint8* p) {
+return (guint64) get32(p) | ((guint64) get32(p + 4) << 32);
+}
+
+gboolean
+_aks_zip_read_directory(FileArchive    *archive,
+                        ZipEntryFunc    func,
+                        gpointer        user_data,
+                        GCancellable   *cancellable,
+                        GError        **error)
+{
+  gboolean success = TRUE;
+  GError* tmp_err = NULL;
+  guint8* tail = NULL;
+  guint8* directory = NULL;
+  GString* name = NULL;
+
+  goffset size =
+  _aks_archive_get_size(archive, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    goto_error();
+  }
+
+  if G_UNLIKELY(size < ZIP_EOCD_SIZE)
+  {
+    g_set_error
+    (error,
+     AKS_FILE_ERROR,
+     AKS_FILE_ERROR_FAILED,
+     "truncated zip archive\r\n");
+    goto_error();
+  }
+
+/*
+ * Find end of central directory
+ * record, which is followed by
+ * a comment of up to 64 KiB
+ *
+ */
+  gsize tail_size = (gsize)
+  MIN(size, ZIP_EOCD_SIZE + ZIP_COMMENT_MAX);
+  goffset tail_offset =
+  size - (goffset) tail_size;
+  tail = g_malloc(tail_size);
+
+  _aks_archive_read_at(archive, tail_offset, tail, tail_size, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    goto_error();
+  }
+
+  const guint8* eocd = NULL;
+  gsize i = tail_size - ZIP_EOCD_SIZE + 1;
+
+  while(i-- > 0)
+  {
+    if(get32(tail + i) == ZIP_EOCD_SIGNATURE)
+    {
+      eocd = tail + i;
+      break;
+    }
+  }
+
+  if G_UNLIKELY(eocd == NULL)
+  {
+    g_set_error
+    (error,
+     AKS_FILE_ERROR,
+     AKS_FILE_ERROR_FAILED,
+     "missing zip central directory\r\n");
+    goto_error();
+  }
+
+  goffset eocd_offset = tail_offset + (eocd - tail);
+  guint64 entries = get16(eocd + 10);
+  guint64 cd_size = get32(eocd + 12);
+  guint64 cd_offset = get32(eocd + 16);
+
+/*
+ * Zip64 archives park real
+ * values on another record,
+ * pointed by a locator right
+ * before the classic one
+ *
+ */
+  if(entries == 0xffff
+     || cd_size == 0xffffffff
+     || cd_offset == 0xffffffff)
+  {
+    guint8 locator[ZIP_LOCATOR_SIZE];
+    guint8 eocd64[ZIP_EOCD64_SIZE];
+
+    if G_UNLIKELY(eocd_offset < ZIP_LOCATOR_SIZE)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FAILED,
+       "missing zip64 locator\r\n");
+      goto_error();
+    }
+
+    _aks_archive_read_at(archive, eocd_offset - ZIP_LOCATOR_SIZE, locator, sizeof(locator), cancellable, &tmp_err);
+    if G_UNLIKELY(tmp_err != NULL)
+    {
+      g_propagate_error(error, tmp_err);
+      goto_error();
+    }
+
+    if G_UNLIKELY(get32(locator) != ZIP_LOCATOR_SIGNATURE)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FAILED,
+       "missing zip64 locator\r\n");
+      goto_error();
+    }
+
+  /*
+   * Recorded offset is off by
+   * as much as any other when
+   * something was prepended, so
+   * record is looked for right
+   * before locator first (where
+   * it is unless it carries
+   * extensible data)
+   *
+   */
+    goffset locator_offset = eocd_offset - ZIP_LOCATOR_SIZE;
+    goffset eocd64_offset = locator_offset - ZIP_EOCD64_SIZE;
+    goffset recorded = (goffset) get64(locator + 8);
+
+    if(eocd64_offset >= 0)
+    {
+      _aks_archive_read_at(archive, eocd64_offset, eocd64, sizeof(eocd64), cancellable, &tmp_err);
+      if G_UNLIKELY(tmp_err != NULL)
+      {
+        g_propagate_error(error, tmp_err);
+        goto_error();
+      }
+    }
+
+    if(eocd64_offset < 0
+       || get32(eocd64) != ZIP_EOCD64_SIGNATURE)
+    {
+      eocd64_offset = recorded;
+
+      _aks_archive_read_at(archive, eocd64_offset, eocd64, sizeof(eocd64), cancellable, &tmp_err);
+      if G_UNLIKELY(tmp_err != NULL)
+      {
+        g_propagate_error(error, tmp_err);
+        goto_error();
+      }
+    }
+
+    if G_UNLIKELY(get32(eocd64) != ZIP_EOCD64_SIGNATURE)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FAILED,
+       "malformed zip64 end of central directory\r\n");
+      goto_error();
+    }
+
+    entries = get64(eocd64 + 32);
+    cd_size = get64(eocd64 + 40);
+    cd_offset = get64(eocd64 + 48);
+    eocd_offset = eocd64_offset;
+  }
+
+/*
+ * Offsets are off when something
+ * was prepended to archive (self
+ * extracting archives, for example),
+ * central directory sits right
+ * before its end record anyway
+ *
+ */
+  if G_UNLIKELY
+    (cd_size > (guint64) eocd_offset
+     || cd_size > G_MAXSIZE)
+  {
+    g_set_error
+    (error,
+     AKS_FILE_ERROR,
+     AKS_FILE_ERROR_FAILED,
+     "malformed zip central directory\r\n");
+    goto_error();
+  }
+
+  goffset cd_start = eocd_offset - (goffset) cd_size;
+  goffset delta = cd_start - (goffset) cd_offset;
+
+  directory = g_malloc(cd_size);
+  _aks_archive_read_at(archive, cd_start, directory, (gsize) cd_size, cancellable, &tmp_err);
+  if G_UNLIKELY(tmp_err != NULL)
+  {
+    g_propagate_error(error, tmp_err);
+    goto_error();
+  }
+
+/*
+ * Walk central directory
+ *
+ */
+  const guint8* p = directory;
+  const guint8* end = directory + cd_size;
+  name = g_string_sized_new(256);
+
+  for(; entries > 0; entries--)
+  {
+    if G_UNLIKELY
+      (end - p < ZIP_CDENTRY_SIZE
+       || get32(p) != ZIP_CDENTRY_SIGNATURE)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FAILED,
+       "malformed zip central directory\r\n");
+      goto_error();
+    }
+
+    guint32 csize = get32(p + 20);
+    guint32 usize = get32(p + 24);
+    gsize name_len = get16(p + 28);
+    gsize extra_len = get16(p + 30);
+    gsize comment_len = get16(p + 32);
+    guint64 offset = get32(p + 42);
+
+    if G_UNLIKELY
+      ((gsize) (end - p) < ZIP_CDENTRY_SIZE + name_len + extra_len + comment_len)
+    {
+      g_set_error
+      (error,
+       AKS_FILE_ERROR,
+       AKS_FILE_ERROR_FAILED,
+       "malformed zip central directory\r\n");
+      goto_error();
+    }
+
+  /*
+   * Zip64 extra field holds 64-bit
+   * values for those fields set
+   * to all ones, in fixed order
+   *
+   */
+    if(offset == 0xffffffff)
+    {
+      const guint8* extra = p + ZIP_CDENTRY_SIZE + name_len;
+      const guint8* extra_end = extra + extra_len;
+
+      while(extra_end - extra >= 4)
+      {
+        guint16 id = get16(extra);
+        guint16 len = get16(extra + 2);
+        const guint8* field = extra + 4;
+        extra = field + len;
+
+        if G_UNLIKELY(extra > extra_end)
+          break;
+
+        if(id == ZIP_EXTRA_ZIP64)
+        {
+          if(usize == 0xffffffff)
+            field += 8;
+          if(csize == 0xffffffff)
+            field += 8;
+          if(field + 8 <= extra)
+            offset = get64(field);
+          break;
+        }
+      }
+    }
+
+    g_string_truncate(name, 0);
+    g_string_append_len(name, (const gchar*) p + ZIP_CDENTRY_SIZE, name_len);
+    func(name->str, (goffset) offset + delta, user_data);
+
+    p += ZIP_CDENTRY_SIZE + name_len + extra_len + comment_len;
+  }
+
+_error_:
+  g_free(tail);
+  g_free(directory);
+  if(name != NULL)
+    g_string_free(name, TRUE);
+return success;
+}
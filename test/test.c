@@ -17,6 +17,7 @@
  */
 #include <config.h>
 #include <libakashic.h>
+#include <glib/gstdio.h>
 #include <stdio.h>
 
 typedef struct _AksFileFixture AksFileFixture;
@@ -60,37 +61,1120 @@ aks_file_fixture_tear_down(AksFileFixture* fixture,
   g_clear_object(&(fixture->file));
 }
 
+/*
+ * Entries checked against files
+ * they were archived from (test
+ * archive is built along with
+ * test program, see Makefile.am)
+ *
+ */
+static const gchar* entries[] =
+{
+  "/test.c",
+  "/test_hook.c",
+  NULL,
+};
+
+static const gchar* levels[] =
+{
+  "none",
+  "otf",
+  "full",
+  "disk",
+};
+
+static GInputStream*
+open_stream(const gchar* path)
+{
+  GError* tmp_err = NULL;
+  GInputStream* stream;
+
+  GFile* file_ =
+  g_file_new_for_path(path);
+
+  stream = (GInputStream*)
+  g_file_read(file_, NULL, &tmp_err);
+  g_object_unref(file_);
+
+  g_assert_no_error(tmp_err);
+return stream;
+}
+
+static GBytes*
+load_plain(const gchar* path)
+{
+  GError* tmp_err = NULL;
+  gchar* contents = NULL;
+  gsize length = 0;
+
+  g_file_get_contents(path + 1, &contents, &length, &tmp_err);
+  g_assert_no_error(tmp_err);
+return g_bytes_new_take(contents, length);
+}
+
+static GBytes*
+load_entry(GFile         *file,
+           const gchar   *path)
+{
+  GError* tmp_err = NULL;
+  gchar* contents = NULL;
+  gsize length = 0;
+
+  GFile* child =
+  g_file_resolve_relative_path(file, path);
+
+  g_file_load_contents(child, NULL, &contents, &length, NULL, &tmp_err);
+  g_object_unref(child);
+  g_assert_no_error(tmp_err);
+return g_bytes_new_take(contents, length);
+}
+
+static void
+assert_bytes_equal(GBytes* bytes1,
+                   GBytes* bytes2)
+{
+  gsize size1, size2;
+  gconstpointer data1 = g_bytes_get_data(bytes1, &size1);
+  gconstpointer data2 = g_bytes_get_data(bytes2, &size2);
+  g_assert_cmpmem(data1, size1, data2, size2);
+}
+
+static void
+assert_entry(GFile         *file,
+             const gchar   *path)
+{
+  GBytes* plain = load_plain(path);
+  GBytes* bytes = load_entry(file, path);
+  assert_bytes_equal(bytes, plain);
+  g_bytes_unref(plain);
+  g_bytes_unref(bytes);
+}
+
+static void
+assert_entries(GFile* file) {
+  const gchar** path;
+  for(path = entries; *path != NULL; path++)
+    assert_entry(file, *path);
+}
+
 static void
 aks_file_fixture_test_read(AksFileFixture* fixture,
                            gconstpointer user_data)
 {
+  g_object_set
+  (fixture->file,
+   "filename", "/",
+   NULL);
+
+  assert_entries(G_FILE(fixture->file));
+
+/*
+ * Read twice, so cached
+ * contents get checked too
+ *
+ */
+  assert_entries(G_FILE(fixture->file));
+}
+
+static void
+aks_file_fixture_test_index(AksFileFixture* fixture,
+                            gconstpointer user_data)
+{
+  AksCacheLevel level = GPOINTER_TO_INT(user_data);
   GError* tmp_err = NULL;
-  GInputStream* input = (GInputStream*)
-  g_file_read(G_FILE(fixture->file), NULL, &tmp_err);
+  const gchar* name;
+  guint i, count = 0;
+
+  gchar* directory =
+  g_dir_make_tmp("libakashic-XXXXXX", &tmp_err);
+  g_assert_no_error(tmp_err);
+
+/*
+ * First one writes index,
+ * second one reads it
+ *
+ */
+  for(i = 0; i < 2; i++)
+  {
+    GInputStream* stream = open_stream("test.a");
+    GFile* file = (GFile*)
+    g_initable_new
+    (AKS_TYPE_FILE,
+     NULL,
+     &tmp_err,
+     "base-stream", stream,
+     "cache-level", level,
+     "index-directory", directory,
+     "filename", "/",
+     NULL);
+
+    g_assert_no_error(tmp_err);
+    assert_entries(file);
+    g_object_unref(file);
+    g_object_unref(stream);
+  }
+
+  GDir* dir = g_dir_open(directory, 0, &tmp_err);
+  g_assert_no_error(tmp_err);
+
+  while((name = g_dir_read_name(dir)) != NULL)
+  {
+    gchar* path = g_build_filename(directory, name, NULL);
+    g_assert_true(g_str_has_suffix(name, ".index"));
+    g_remove(path);
+    g_free(path);
+    count++;
+  }
+
+/*
+ * Levels which decompress
+ * everything anyway have
+ * no use for an index
+ *
+ */
+  if(level == AKS_CACHE_LEVEL_NONE
+     || level == AKS_CACHE_LEVEL_OTF)
+    g_assert_cmpuint(count, ==, 1);
+  else
+    g_assert_cmpuint(count, ==, 0);
+
+  g_dir_close(dir);
+  g_rmdir(directory);
+  g_free(directory);
+}
+
+static void
+aks_file_fixture_test_checkpoints(AksFileFixture* fixture,
+                                  gconstpointer user_data)
+{
+  GInputStream* stream = open_stream("test.a.gz");
+  GError* tmp_err = NULL;
+
+  GFile* file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-stream", stream,
+   "cache-level", GPOINTER_TO_INT(user_data),
+   "checkpoint-interval", (guint64) 4096,
+   "filename", "/",
+   NULL);
+
+  g_assert_no_error(tmp_err);
+  assert_entries(file);
+
+/*
+ * Read twice, so entries get
+ * resumed from checkpoints
+ *
+ */
+  assert_entries(file);
+  g_object_unref(file);
+  g_object_unref(stream);
+}
+
+static void
+aks_file_fixture_test_pin(AksFileFixture* fixture,
+                          gconstpointer user_data)
+{
+  const gchar** path;
+
+  g_object_set
+  (fixture->file,
+   "filename", "/",
+   NULL);
+
+  for(path = entries; *path != NULL; path++)
+  {
+    GError* tmp_err = NULL;
+    GFile* child = g_file_resolve_relative_path(G_FILE(fixture->file), *path);
+
+    aks_file_pin(child, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+    assert_entry(G_FILE(fixture->file), *path);
+    aks_file_unpin(child);
+    g_object_unref(child);
+  }
+
+  assert_entries(G_FILE(fixture->file));
+}
+
+static void
+aks_file_fixture_test_budget(AksFileFixture* fixture,
+                             gconstpointer user_data)
+{
+  GInputStream* stream = open_stream("test.a");
+  GError* tmp_err = NULL;
+
+/*
+ * Budget fits test_hook.c
+ * but not test.c, which gets
+ * evicted right away
+ *
+ */
+  GFile* file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-stream", stream,
+   "cache-level", GPOINTER_TO_INT(user_data),
+   "cache-budget", (guint64) 1024,
+   "filename", "/",
+   NULL);
+
+  g_assert_no_error(tmp_err);
+  assert_entries(file);
+  assert_entries(file);
+  g_object_unref(file);
+  g_object_unref(stream);
+}
+
+static void
+aks_file_fixture_test_shared_cache(AksFileFixture* fixture,
+                                   gconstpointer user_data)
+{
+  GInputStream* streams[2];
+  GError* tmp_err = NULL;
+  GFile* files[2];
+  guint i;
+
+  aks_file_set_shared_cache_budget(1 << 20);
+
+  for(i = 0; i < G_N_ELEMENTS(files); i++)
+  {
+    streams[i] = open_stream("test.a");
+    files[i] = (GFile*)
+    g_initable_new
+    (AKS_TYPE_FILE,
+     NULL,
+     &tmp_err,
+     "base-stream", streams[i],
+     "cache-level", GPOINTER_TO_INT(user_data),
+     "shared-cache", TRUE,
+     "filename", "/",
+     NULL);
+
+    g_assert_no_error(tmp_err);
+  }
+
+/*
+ * Second one gets what
+ * first one decoded
+ *
+ */
+  for(i = 0; i < G_N_ELEMENTS(files); i++)
+    assert_entries(files[i]);
+  for(i = 0; i < G_N_ELEMENTS(files); i++)
+  {
+    g_object_unref(files[i]);
+    g_object_unref(streams[i]);
+  }
+}
+
+/*
+ * Async calls are waited for
+ * on default main context
+ *
+ */
+
+typedef struct _AsyncWait AsyncWait;
+struct _AsyncWait
+{
+  GAsyncResult* result;
+};
+
+static void
+on_async_ready(GObject        *source_object,
+               GAsyncResult   *res,
+               AsyncWait      *wait)
+{
+  wait->result = g_object_ref(res);
+}
+
+static GAsyncResult*
+async_wait(AsyncWait* wait)
+{
+  while(wait->result == NULL)
+    g_main_context_iteration(NULL, TRUE);
+  while(g_main_context_pending(NULL))
+    g_main_context_iteration(NULL, FALSE);
+return wait->result;
+}
+
+static void
+aks_file_fixture_test_new_for_file(AksFileFixture* fixture,
+                                   gconstpointer user_data)
+{
+  AksCacheLevel level = GPOINTER_TO_INT(user_data);
+  GFile* base_file = g_file_new_for_path("test.a");
+  AsyncWait wait = {NULL};
+  GError* tmp_err = NULL;
+
+  GFile* file =
+  aks_file_new_for_file(base_file, level, "/", NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  assert_entries(file);
+  g_object_unref(file);
+
+  aks_file_new_for_file_async
+  (base_file,
+   level,
+   "/",
+   G_PRIORITY_DEFAULT,
+   NULL,
+   (GAsyncReadyCallback)
+   on_async_ready,
+   &wait);
 
+  file = aks_file_new_finish(async_wait(&wait), &tmp_err);
+  g_clear_object(&(wait.result));
   g_assert_no_error(tmp_err);
+  assert_entries(file);
+  g_object_unref(file);
 
-  GFile* stdout = g_file_new_for_path("/dev/stdout");
-  GOutputStream* output = (GOutputStream*)
-  g_file_append_to(stdout, G_FILE_CREATE_NONE, NULL, &tmp_err);
-  g_object_unref(stdout);
+/*
+ * Several readers at once, each
+ * on a stream of its own
+ *
+ */
+  file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-file", base_file,
+   "cache-level", level,
+   "max-readers", 2,
+   "filename", "/",
+   NULL);
 
   g_assert_no_error(tmp_err);
+  assert_entries(file);
+  g_object_unref(file);
 
-  g_output_stream_splice
+/*
+ * Neither stream nor file
+ *
+ */
+  file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "cache-level", level,
+   "filename", "/",
+   NULL);
+
+  g_assert_error(tmp_err, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_assert_null(file);
+  g_clear_error(&tmp_err);
+  g_object_unref(base_file);
+}
+
+static void
+assert_stream(GFile    *file,
+              GBytes   *plain)
+{
+  GError* tmp_err = NULL;
+
+/*
+ * Read in chunks
+ *
+ */
+  GInputStream* input = (GInputStream*)
+  g_file_read(file, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+
+  GByteArray* array = g_byte_array_new();
+  for(;;)
+  {
+    GBytes* bytes =
+    aks_stream_read_bytes(input, 4096, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+
+    gsize size;
+    gconstpointer data = g_bytes_get_data(bytes, &size);
+    g_byte_array_append(array, data, size);
+    g_bytes_unref(bytes);
+
+    if(size == 0)
+      break;
+  }
+
+  GBytes* bytes = g_byte_array_free_to_bytes(array);
+  assert_bytes_equal(bytes, plain);
+  g_bytes_unref(bytes);
+  g_object_unref(input);
+
+/*
+ * Splice it all
+ *
+ */
+  input = (GInputStream*)
+  g_file_read(file, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+
+  GOutputStream* output =
+  g_memory_output_stream_new_resizable();
+
+  aks_stream_splice
   (output,
    input,
    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE
    | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
    NULL,
    &tmp_err);
-
   g_assert_no_error(tmp_err);
 
+  bytes = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(output));
+  assert_bytes_equal(bytes, plain);
+  g_bytes_unref(bytes);
   g_object_unref(output);
   g_object_unref(input);
 }
 
+static void
+aks_file_fixture_test_stream(AksFileFixture* fixture,
+                             gconstpointer user_data)
+{
+  const gchar** path;
+
+  g_object_set
+  (fixture->file,
+   "filename", "/",
+   NULL);
+
+  for(path = entries; *path != NULL; path++)
+  {
+    GBytes* plain = load_plain(*path);
+    GFile* child = g_file_resolve_relative_path(G_FILE(fixture->file), *path);
+    assert_stream(child, plain);
+    g_object_unref(child);
+    g_bytes_unref(plain);
+  }
+}
+
+static void
+assert_read(GInputStream   *input,
+            GBytes         *plain,
+            goffset         offset,
+            gsize           count)
+{
+  GError* tmp_err = NULL;
+  gsize size, read = 0;
+  const guint8* data = g_bytes_get_data(plain, &size);
+  guint8* buffer = g_malloc(count);
+
+  g_assert_cmpint(g_seekable_tell(G_SEEKABLE(input)), ==, offset);
+  g_input_stream_read_all(input, buffer, count, &read, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+
+  count = (gsize) MIN((goffset) count, (goffset) size - offset);
+  g_assert_cmpmem(buffer, read, data + offset, count);
+  g_free(buffer);
+}
+
+static void
+assert_seek(GFile    *file,
+            GBytes   *plain)
+{
+  GError* tmp_err = NULL;
+  goffset size = (goffset) g_bytes_get_size(plain);
+  goffset middle = size / 2;
+  gsize skipped;
+
+  GInputStream* input = (GInputStream*)
+  g_file_read(file, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  g_assert_true(g_seekable_can_seek(G_SEEKABLE(input)));
+
+/*
+ * Forward onto middle, back
+ * to start, on through a skip
+ * and from end
+ *
+ */
+  g_seekable_seek(G_SEEKABLE(input), middle - 2, G_SEEK_SET, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  assert_read(input, plain, middle - 2, 16);
+
+  g_seekable_seek(G_SEEKABLE(input), 2, G_SEEK_SET, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  assert_read(input, plain, 2, 16);
+
+  g_seekable_seek(G_SEEKABLE(input), 1000, G_SEEK_CUR, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  assert_read(input, plain, 1018, 16);
+
+  skipped = g_input_stream_skip(input, 4096, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  g_assert_cmpuint(skipped, ==, MIN(4096, size - 1034));
+  assert_read(input, plain, 1034 + skipped, 16);
+
+  g_seekable_seek(G_SEEKABLE(input), -16, G_SEEK_END, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  assert_read(input, plain, size - 16, 32);
+
+  g_seekable_seek(G_SEEKABLE(input), -size, G_SEEK_END, NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+  assert_read(input, plain, 0, 16);
+
+  g_object_unref(input);
+}
+
+static void
+aks_file_fixture_test_seek(AksFileFixture* fixture,
+                           gconstpointer user_data)
+{
+/*
+ * test_hook.c is too short
+ * for offsets used here
+ *
+ */
+  GBytes* plain = load_plain("/test.c");
+  assert_seek(G_FILE(fixture->file), plain);
+  g_bytes_unref(plain);
+}
+
+static void
+aks_file_fixture_test_skip(AksFileFixture* fixture,
+                           gconstpointer user_data)
+{
+  const gchar** path;
+
+  g_object_set
+  (fixture->file,
+   "filename", "/",
+   NULL);
+
+  for(path = entries; *path != NULL; path++)
+  {
+    GError* tmp_err = NULL;
+    GBytes* plain = load_plain(*path);
+    gsize size = g_bytes_get_size(plain);
+    gsize skipped;
+    guint8 buffer[16];
+    gssize read;
+
+    GFile* child =
+    g_file_resolve_relative_path(G_FILE(fixture->file), *path);
+    GInputStream* input = (GInputStream*)
+    g_file_read(child, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+
+  /*
+   * Skipping past entry end
+   * stops there, so nothing
+   * is left to read
+   *
+   */
+    skipped = g_input_stream_skip(input, size + 100, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpuint(skipped, ==, size);
+
+    read = g_input_stream_read(input, buffer, sizeof(buffer), NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(read, ==, 0);
+
+    g_object_unref(input);
+    g_object_unref(child);
+    g_bytes_unref(plain);
+  }
+}
+
+static void
+aks_file_fixture_test_formats(AksFileFixture* fixture,
+                              gconstpointer user_data)
+{
+  AksCacheLevel level = GPOINTER_TO_INT(user_data);
+  GFile* base_file = g_file_new_for_path("test.a.gz");
+  const gchar* formats[] = {"ar", NULL};
+  const gchar* filters[] = {"gzip", NULL};
+  const gchar* wrong[] = {"zip", NULL};
+  const gchar* unknown[] = {"tarball", NULL};
+  GError* tmp_err = NULL;
+  GFile* file;
+
+/*
+ * Allowed formats and filters
+ *
+ */
+  file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-file", base_file,
+   "cache-level", level,
+   "formats", formats,
+   "filters", filters,
+   "filename", "/",
+   NULL);
+
+  g_assert_no_error(tmp_err);
+  assert_entries(file);
+  assert_entries(file);
+  g_object_unref(file);
+
+/*
+ * Archive in a format not
+ * allowed, and a name which
+ * isn't a filter at all
+ *
+ */
+  file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-file", base_file,
+   "cache-level", level,
+   "formats", wrong,
+   "filename", "/",
+   NULL);
+
+  g_assert_nonnull(tmp_err);
+  g_assert_null(file);
+  g_clear_error(&tmp_err);
+
+  file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-file", base_file,
+   "cache-level", level,
+   "filters", unknown,
+   "filename", "/",
+   NULL);
+
+  g_assert_error(tmp_err, AKS_FILE_ERROR, AKS_FILE_ERROR_FAILED);
+  g_assert_null(file);
+  g_clear_error(&tmp_err);
+  g_object_unref(base_file);
+}
+
+typedef struct _ReadManyCheck ReadManyCheck;
+struct _ReadManyCheck
+{
+  GPtrArray* paths;
+  guint limit;
+};
+
+static gboolean
+on_read_many(const gchar     *path,
+             GBytes          *bytes,
+             ReadManyCheck   *check)
+{
+  GBytes* plain = load_plain(path);
+  assert_bytes_equal(bytes, plain);
+  g_bytes_unref(plain);
+
+  g_ptr_array_add(check->paths, g_strdup(path));
+return check->paths->len < check->limit;
+}
+
+static void
+aks_file_fixture_test_read_many(AksFileFixture* fixture,
+                                gconstpointer user_data)
+{
+  const gchar* paths[] = {"/test_hook.c", "/test.c", NULL};
+  ReadManyCheck check = {NULL, G_MAXUINT};
+  GError* tmp_err = NULL;
+  gboolean success;
+
+/*
+ * Entries come back in
+ * archive order
+ *
+ */
+  check.paths = g_ptr_array_new_with_free_func(g_free);
+  success =
+  aks_file_read_many
+  (G_FILE(fixture->file),
+   paths,
+   (AksFileReadFunc)
+   on_read_many,
+   &check,
+   NULL,
+   &tmp_err);
+
+  g_assert_no_error(tmp_err);
+  g_assert_true(success);
+  g_assert_cmpuint(check.paths->len, ==, 2);
+  g_assert_cmpstr(g_ptr_array_index(check.paths, 0), ==, "/test.c");
+  g_assert_cmpstr(g_ptr_array_index(check.paths, 1), ==, "/test_hook.c");
+  g_ptr_array_unref(check.paths);
+
+/*
+ * Callback may stop
+ * it early
+ *
+ */
+  check.paths = g_ptr_array_new_with_free_func(g_free);
+  check.limit = 1;
+  success =
+  aks_file_read_many
+  (G_FILE(fixture->file),
+   paths,
+   (AksFileReadFunc)
+   on_read_many,
+   &check,
+   NULL,
+   &tmp_err);
+
+  g_assert_no_error(tmp_err);
+  g_assert_true(success);
+  g_assert_cmpuint(check.paths->len, ==, 1);
+  g_assert_cmpstr(g_ptr_array_index(check.paths, 0), ==, "/test.c");
+  g_ptr_array_unref(check.paths);
+
+/*
+ * Missing entries fail
+ * before anything is read
+ *
+ */
+  const gchar* missing[] = {"/test.c", "/missing.c", NULL};
+  check.paths = g_ptr_array_new_with_free_func(g_free);
+  check.limit = G_MAXUINT;
+
+  success =
+  aks_file_read_many
+  (G_FILE(fixture->file),
+   missing,
+   (AksFileReadFunc)
+   on_read_many,
+   &check,
+   NULL,
+   &tmp_err);
+
+  g_assert_error(tmp_err, AKS_FILE_ERROR, AKS_FILE_ERROR_FILE_NOT_FOUND);
+  g_assert_false(success);
+  g_clear_error(&tmp_err);
+
+  g_assert_cmpuint(check.paths->len, ==, 0);
+  g_ptr_array_unref(check.paths);
+}
+
+typedef struct _PrefetchCheck PrefetchCheck;
+struct _PrefetchCheck
+{
+  goffset current;
+  goffset total;
+  guint calls;
+  GThread* thread;
+};
+
+static void
+on_prefetch_progress(goffset          current,
+                     goffset          total,
+                     PrefetchCheck   *check)
+{
+  g_assert_true(g_thread_self() == check->thread);
+  g_assert_cmpint(current, <=, total);
+  g_assert_cmpint(current, >=, check->current);
+  check->current = current;
+  check->total = total;
+  check->calls++;
+}
+
+static void
+aks_file_fixture_test_prefetch(AksFileFixture* fixture,
+                               gconstpointer user_data)
+{
+  const gchar* paths[] = {"/test*.c", "/test.c", NULL};
+  PrefetchCheck check = {0, 0, 0, g_thread_self()};
+  AsyncWait wait = {NULL};
+  GError* tmp_err = NULL;
+  gboolean success;
+
+  g_object_set
+  (fixture->file,
+   "filename", "/",
+   NULL);
+
+  aks_file_prefetch_async
+  (G_FILE(fixture->file),
+   paths,
+   G_PRIORITY_DEFAULT,
+   NULL,
+   (GFileProgressCallback)
+   on_prefetch_progress,
+   &check,
+   (GAsyncReadyCallback)
+   on_async_ready,
+   &wait);
+
+  success =
+  aks_file_prefetch_finish
+  (G_FILE(fixture->file),
+   async_wait(&wait),
+   &tmp_err);
+  g_clear_object(&(wait.result));
+
+  g_assert_no_error(tmp_err);
+  g_assert_true(success);
+
+/*
+ * Only on-the-fly cache has
+ * anything to prefetch, every
+ * entry once (test.c is listed
+ * twice, pattern is matched
+ * against canonical names)
+ *
+ */
+  if(GPOINTER_TO_INT(user_data) == AKS_CACHE_LEVEL_OTF)
+  {
+    g_assert_cmpuint(check.calls, ==, 2);
+    g_assert_cmpint(check.current, ==, check.total);
+  }
+  else
+  {
+    g_assert_cmpuint(check.calls, ==, 0);
+  }
+
+  assert_entries(G_FILE(fixture->file));
+
+/*
+ * Missing entries fail
+ *
+ */
+  const gchar* missing[] = {"/missing.c", NULL};
+
+  aks_file_prefetch_async
+  (G_FILE(fixture->file),
+   missing,
+   G_PRIORITY_DEFAULT,
+   NULL,
+   NULL,
+   NULL,
+   (GAsyncReadyCallback)
+   on_async_ready,
+   &wait);
+
+  success =
+  aks_file_prefetch_finish
+  (G_FILE(fixture->file),
+   async_wait(&wait),
+   &tmp_err);
+  g_clear_object(&(wait.result));
+
+  if(GPOINTER_TO_INT(user_data) == AKS_CACHE_LEVEL_OTF)
+  {
+    g_assert_error(tmp_err, AKS_FILE_ERROR, AKS_FILE_ERROR_FILE_NOT_FOUND);
+    g_assert_false(success);
+    g_clear_error(&tmp_err);
+  }
+  else
+  {
+    g_assert_no_error(tmp_err);
+    g_assert_true(success);
+  }
+}
+
+/*
+ * Concurrent readers of an entry
+ * nobody has cached yet (cache budget
+ * is too small to keep anything when
+ * told so, so contents get handed
+ * from whoever decodes to others)
+ *
+ */
+
+typedef struct _ReaderThread ReaderThread;
+struct _ReaderThread
+{
+  GFile* file;
+  GBytes* bytes;
+  GError* error;
+};
+
+static gpointer
+reader_thread(ReaderThread* reader)
+{
+  gchar* contents = NULL;
+  gsize length = 0;
+
+  if(g_file_load_contents(reader->file, NULL, &contents, &length, NULL, &(reader->error)))
+    reader->bytes = g_bytes_new_take(contents, length);
+return NULL;
+}
+
+/*
+ * Readers alternate between
+ * both files and both entries
+ *
+ */
+static void
+assert_concurrent_reads(GFile** files)
+{
+  ReaderThread readers[16];
+  GThread* threads[16];
+  guint i;
+
+  for(i = 0; i < G_N_ELEMENTS(readers); i++)
+  {
+    readers[i].file = g_file_resolve_relative_path(files[i & 1], entries[(i >> 1) & 1]);
+    readers[i].bytes = NULL;
+    readers[i].error = NULL;
+  }
+
+  for(i = 0; i < G_N_ELEMENTS(threads); i++)
+    threads[i] = g_thread_new("reader", (GThreadFunc) reader_thread, &(readers[i]));
+  for(i = 0; i < G_N_ELEMENTS(threads); i++)
+    g_thread_join(threads[i]);
+
+  for(i = 0; i < G_N_ELEMENTS(readers); i++)
+  {
+    GBytes* plain = load_plain(entries[(i >> 1) & 1]);
+    g_assert_no_error(readers[i].error);
+    assert_bytes_equal(readers[i].bytes, plain);
+    g_bytes_unref(readers[i].bytes);
+    g_object_unref(readers[i].file);
+    g_bytes_unref(plain);
+  }
+}
+
+static void
+test_single_flight(gconstpointer user_data)
+{
+  GFile* base_file = g_file_new_for_path("test.a");
+  GError* tmp_err = NULL;
+
+  GFile* file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-file", base_file,
+   "cache-level", AKS_CACHE_LEVEL_OTF,
+   "cache-budget", (guint64) GPOINTER_TO_SIZE(user_data),
+   "filename", "/",
+   NULL);
+
+  g_assert_no_error(tmp_err);
+
+  GFile* files[] = {file, file};
+  assert_concurrent_reads(files);
+
+  g_object_unref(file);
+  g_object_unref(base_file);
+}
+
+/*
+ * Files on same archive sharing
+ * cache share fill claims too
+ * (shared budget is too small
+ * to keep anything)
+ *
+ */
+static void
+test_single_flight_shared(void)
+{
+  GFile* base_file = g_file_new_for_path("test.a");
+  GError* tmp_err = NULL;
+  GFile* files[2];
+  guint i;
+
+  aks_file_set_shared_cache_budget(1);
+
+  for(i = 0; i < G_N_ELEMENTS(files); i++)
+  {
+    files[i] = (GFile*)
+    g_initable_new
+    (AKS_TYPE_FILE,
+     NULL,
+     &tmp_err,
+     "base-file", base_file,
+     "cache-level", AKS_CACHE_LEVEL_OTF,
+     "shared-cache", TRUE,
+     "filename", "/",
+     NULL);
+
+    g_assert_no_error(tmp_err);
+  }
+
+  assert_concurrent_reads(files);
+
+  for(i = 0; i < G_N_ELEMENTS(files); i++)
+    g_object_unref(files[i]);
+  g_object_unref(base_file);
+}
+
+static void
+aks_file_fixture_test_sparse(AksFileFixture* fixture,
+                             gconstpointer user_data)
+{
+  GFile* base_file = g_file_new_for_path("sparse.tar");
+  GBytes* plain = load_plain("/sparse.bin");
+  GError* tmp_err = NULL;
+
+/*
+ * sparse.bin has holes in
+ * between and at its end
+ * (middle seeks land on
+ * a hole followed by data)
+ *
+ */
+  GFile* file =
+  aks_file_new_for_file(base_file, GPOINTER_TO_INT(user_data), "/sparse.bin", NULL, &tmp_err);
+  g_assert_no_error(tmp_err);
+
+  GBytes* bytes = load_entry(file, "/sparse.bin");
+  assert_bytes_equal(bytes, plain);
+  g_bytes_unref(bytes);
+
+  assert_stream(file, plain);
+  assert_seek(file, plain);
+
+  g_object_unref(file);
+  g_object_unref(base_file);
+  g_bytes_unref(plain);
+}
+
+static void
+aks_file_fixture_test_raw(AksFileFixture* fixture,
+                          gconstpointer user_data)
+{
+  GFile* base_file = g_file_new_for_path("test.c.gz");
+  GBytes* plain = load_plain("/test.c");
+  const gchar* formats[] = {"raw", NULL};
+  GError* tmp_err = NULL;
+
+/*
+ * Raw format doesn't tell
+ * entry size, so skips and
+ * seeks from end have to
+ * walk entry contents
+ *
+ */
+  GFile* file = (GFile*)
+  g_initable_new
+  (AKS_TYPE_FILE,
+   NULL,
+   &tmp_err,
+   "base-file", base_file,
+   "cache-level", GPOINTER_TO_INT(user_data),
+   "formats", formats,
+   "filename", "/data",
+   NULL);
+
+  g_assert_no_error(tmp_err);
+
+  GBytes* bytes = load_entry(file, "/data");
+  assert_bytes_equal(bytes, plain);
+  g_bytes_unref(bytes);
+
+  assert_stream(file, plain);
+  assert_seek(file, plain);
+
+  g_object_unref(file);
+  g_object_unref(base_file);
+  g_bytes_unref(plain);
+}
+
 typedef union  _EnumNode      EnumNode;
 typedef struct _EnumNodeData  EnumNodeData;
 
@@ -401,6 +1485,39 @@ aks_file_fixture_test_enumerator(AksFileFixture* fixture,
   g_node_destroy(&(node->node_));
 }
 
+typedef void (*AksFileFixtureFunc) (AksFileFixture *fixture, gconstpointer user_data);
+
+/*
+ * Registers a case per
+ * cache level
+ *
+ */
+static void
+add_cases(const gchar          *name,
+          AksFileFixtureFunc    func)
+{
+  guint level;
+
+  for(level = 0; level < G_N_ELEMENTS(levels); level++)
+  {
+    gchar* path =
+    g_strdup_printf
+    ("/libakashic/aks_file/cache_level_%s/%s",
+     levels[level],
+     name);
+
+    g_test_add
+    (path,
+     AksFileFixture,
+     GINT_TO_POINTER(level),
+     aks_file_fixture_set_up,
+     func,
+     aks_file_fixture_tear_down);
+
+    g_free(path);
+  }
+}
+
 int main(int argc, char* argv[]) {
   g_test_init(&argc, &argv, NULL);
 
@@ -408,31 +1525,41 @@ int main(int argc, char* argv[]) {
  * Test file read
  *
  */
-#if 0
-  g_test_add
-  ("/libakashic/aks_file/cache_level_none",
-   AksFileFixture,
-   (gpointer) AKS_CACHE_LEVEL_NONE,
-   aks_file_fixture_set_up,
-   aks_file_fixture_test_read,
-   aks_file_fixture_tear_down);
+  add_cases("read", aks_file_fixture_test_read);
 
-  g_test_add
-  ("/libakashic/aks_file/cache_level_otf",
-   AksFileFixture,
-   (gpointer) AKS_CACHE_LEVEL_OTF,
-   aks_file_fixture_set_up,
-   aks_file_fixture_test_read,
-   aks_file_fixture_tear_down);
+/*
+ * Test archive features
+ *
+ */
+  add_cases("index", aks_file_fixture_test_index);
+  add_cases("checkpoints", aks_file_fixture_test_checkpoints);
+  add_cases("pin", aks_file_fixture_test_pin);
+  add_cases("budget", aks_file_fixture_test_budget);
+  add_cases("shared_cache", aks_file_fixture_test_shared_cache);
+  add_cases("new_for_file", aks_file_fixture_test_new_for_file);
+  add_cases("stream", aks_file_fixture_test_stream);
+  add_cases("seek", aks_file_fixture_test_seek);
+  add_cases("skip", aks_file_fixture_test_skip);
+  add_cases("formats", aks_file_fixture_test_formats);
+  add_cases("read_many", aks_file_fixture_test_read_many);
+  add_cases("prefetch", aks_file_fixture_test_prefetch);
+  add_cases("sparse", aks_file_fixture_test_sparse);
+  add_cases("raw", aks_file_fixture_test_raw);
+
+  g_test_add_data_func
+  ("/libakashic/aks_file/single_flight",
+   GSIZE_TO_POINTER(0),
+   test_single_flight);
+
+  g_test_add_data_func
+  ("/libakashic/aks_file/single_flight_uncached",
+   GSIZE_TO_POINTER(1),
+   test_single_flight);
+
+  g_test_add_func
+  ("/libakashic/aks_file/single_flight_shared",
+   test_single_flight_shared);
 
-  g_test_add
-  ("/libakashic/aks_file/cache_level_full",
-   AksFileFixture,
-   (gpointer) AKS_CACHE_LEVEL_FULL,
-   aks_file_fixture_set_up,
-   aks_file_fixture_test_read,
-   aks_file_fixture_tear_down);
-#endif // 0
 /*
  * Test file info
  *